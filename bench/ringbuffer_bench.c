@@ -0,0 +1,415 @@
+/*
+ * Ring Buffer benchmark suite
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ *
+ * ringbuffer.h does not depend on seL4, so this runs natively on the host or
+ * any Linux target. See CMakeLists.txt in this folder for building it.
+ *
+ * Usage: ringbuffer_bench [bytes per run]
+ *
+ * For each capacity, indexing mode, wrap pattern, operation and chunk size the
+ * same amount of data is passed through a buffer, and the time per byte and
+ * the calls per second are reported. Finally, a producer and a consumer thread
+ * pass data through a shared buffer. Comparing the results of the executables
+ * built with and without RINGBUFFER_CACHE_LINE_SIZE on a multi-core machine
+ * shows the effect of the cache line aware layout.
+ *
+ * On x86-64, the generic tuning makes gcc expand a memcpy() with a size that is
+ * known to be bounded as "rep movsq", which is slow for small sizes and hits
+ * the fixed capacity buffer. Building with -march=native avoids this.
+ */
+
+#include "ringbuffer.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_FIXED_CAPACITY    4096
+#define BENCH_MAX_CAPACITY      (64 * 1024)
+#define BENCH_DEFAULT_BYTES     (8 * 1024 * 1024)
+
+RINGBUFFER_DECLARE(bench_fixed, BENCH_FIXED_CAPACITY)
+
+typedef enum
+{
+    MODE_MODULO,
+    MODE_POW2,
+    MODE_MIRRORED,
+    MODE_FIXED,
+} bench_mode_t;
+
+typedef enum
+{
+    // Write a chunk and read it back right away. The buffer stays almost empty
+    // and wraps around every capacity/chunk iterations.
+    PATTERN_STREAM,
+    // Fill the buffer completely, then drain it. Every write and read runs
+    // into the wrap point at some time.
+    PATTERN_FILL_DRAIN,
+} bench_pattern_t;
+
+typedef enum
+{
+    OP_COPY,        // ringbuffer_write() and ringbuffer_read()
+    OP_ZERO_COPY,   // ringbuffer_write() and ringbuffer_getReadPtr()/flush()
+} bench_op_t;
+
+typedef struct
+{
+    ringbuffer_t*   rb;
+    bench_fixed_t*  fixed;
+    bench_mode_t    mode;
+} bench_ring_t;
+
+typedef struct
+{
+    size_t  bytes;
+    size_t  calls;
+} bench_result_t;
+
+static uint8_t storage[2 * BENCH_MAX_CAPACITY];
+static uint8_t chunk[BENCH_MAX_CAPACITY];
+static bench_fixed_t rb_fixed;
+
+static const char* const mode_names[] = {
+    [MODE_MODULO]   = "modulo",
+    [MODE_POW2]     = "pow2",
+    [MODE_MIRRORED] = "mirrored",
+    [MODE_FIXED]    = "fixed",
+};
+
+static const char* const pattern_names[] = {
+    [PATTERN_STREAM]     = "stream",
+    [PATTERN_FILL_DRAIN] = "fill-drain",
+};
+
+static const char* const op_names[] = {
+    [OP_COPY]      = "copy",
+    [OP_ZERO_COPY] = "zero-copy",
+};
+
+
+//------------------------------------------------------------------------------
+static uint64_t
+get_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+
+//------------------------------------------------------------------------------
+static size_t
+bench_write(
+    bench_ring_t* ring,
+    size_t len)
+{
+    return (MODE_FIXED == ring->mode)
+           ? bench_fixed_write(ring->fixed, chunk, len)
+           : ringbuffer_write(ring->rb, chunk, len);
+}
+
+
+//------------------------------------------------------------------------------
+// Consume up to len bytes, returns the number of bytes and adds the number of
+// calls needed to the result.
+static size_t
+bench_consume(
+    bench_ring_t* ring,
+    bench_op_t op,
+    size_t len,
+    bench_result_t* res)
+{
+    if (OP_COPY == op)
+    {
+        res->calls++;
+        return (MODE_FIXED == ring->mode)
+               ? bench_fixed_read(ring->fixed, chunk, len)
+               : ringbuffer_read(ring->rb, chunk, len);
+    }
+
+    // A consumer that processes in place has to repeat this if the data wraps
+    // around, unless the buffer is mirrored.
+    size_t done = 0;
+    while (done < len)
+    {
+        void* ptr = NULL;
+        size_t avail = (MODE_FIXED == ring->mode)
+                       ? bench_fixed_getReadPtr(ring->fixed, &ptr)
+                       : ringbuffer_getReadPtr(ring->rb, &ptr);
+        if (0 == avail)
+        {
+            break;
+        }
+        if (avail > len - done)
+        {
+            avail = len - done;
+        }
+
+        // touch the data, so this can't be optimized out
+        (void)((volatile uint8_t*)ptr)[0];
+
+        if (MODE_FIXED == ring->mode)
+        {
+            bench_fixed_flush(ring->fixed, avail);
+        }
+        else
+        {
+            ringbuffer_flush(ring->rb, avail);
+        }
+        done += avail;
+        res->calls += 2;
+    }
+
+    return done;
+}
+
+
+//------------------------------------------------------------------------------
+static bench_result_t
+run_pattern(
+    bench_ring_t* ring,
+    size_t capacity,
+    bench_pattern_t pattern,
+    bench_op_t op,
+    size_t chunk_len,
+    size_t total)
+{
+    bench_result_t res = { 0 };
+
+    while (res.bytes < total)
+    {
+        if (PATTERN_STREAM == pattern)
+        {
+            bench_write(ring, chunk_len);
+            res.calls++;
+            res.bytes += bench_consume(ring, op, chunk_len, &res);
+            continue;
+        }
+
+        size_t filled = 0;
+        while (filled < capacity)
+        {
+            filled += bench_write(ring, chunk_len);
+            res.calls++;
+        }
+        size_t drained = 0;
+        while (drained < capacity)
+        {
+            drained += bench_consume(ring, op, chunk_len, &res);
+        }
+        res.bytes += drained;
+    }
+
+    return res;
+}
+
+
+//------------------------------------------------------------------------------
+static bool
+setup_ring(
+    bench_ring_t* ring,
+    ringbuffer_t* rb,
+    bench_mode_t mode,
+    size_t capacity)
+{
+    ring->rb = rb;
+    ring->fixed = &rb_fixed;
+    ring->mode = mode;
+
+    switch (mode)
+    {
+    case MODE_MODULO:
+        ringbuffer_init(rb, storage, capacity);
+        return true;
+    case MODE_POW2:
+        return ringbuffer_initPow2(rb, storage, capacity);
+    case MODE_MIRRORED:
+        ringbuffer_initMirrored(rb, storage, capacity, RINGBUFFER_MIRROR_COPY);
+        return true;
+    case MODE_FIXED:
+        bench_fixed_init(&rb_fixed);
+        return (BENCH_FIXED_CAPACITY == capacity);
+    default:
+        break;
+    }
+
+    return false;
+}
+
+
+//------------------------------------------------------------------------------
+static void
+run_single_thread(
+    size_t total)
+{
+    static const size_t capacities[] = { 64, 1000, 4096, BENCH_MAX_CAPACITY };
+    static const size_t chunk_sizes[] = { 1, 16, 100, 1024 };
+
+    printf("%7s %9s %11s %10s %6s %9s %10s\n",
+           "cap", "mode", "pattern", "op", "chunk", "ns/byte", "Mcalls/s");
+
+    for (size_t c = 0; c < sizeof(capacities)/sizeof(capacities[0]); c++)
+    {
+        const size_t capacity = capacities[c];
+
+        for (int mode = MODE_MODULO; mode <= MODE_FIXED; mode++)
+        {
+            for (int pattern = PATTERN_STREAM; pattern <= PATTERN_FILL_DRAIN; pattern++)
+            {
+                for (int op = OP_COPY; op <= OP_ZERO_COPY; op++)
+                {
+                    for (size_t k = 0; k < sizeof(chunk_sizes)/sizeof(chunk_sizes[0]); k++)
+                    {
+                        const size_t chunk_len = chunk_sizes[k];
+                        if (chunk_len > capacity)
+                        {
+                            continue;
+                        }
+
+                        ringbuffer_t rb;
+                        bench_ring_t ring;
+                        if (!setup_ring(&ring, &rb, mode, capacity))
+                        {
+                            continue;
+                        }
+
+                        const uint64_t start = get_time_ns();
+                        bench_result_t res = run_pattern(
+                                                &ring, capacity, pattern, op,
+                                                chunk_len, total);
+                        const uint64_t ns = get_time_ns() - start;
+
+                        printf("%7zu %9s %11s %10s %6zu %9.3f %10.2f\n",
+                               capacity, mode_names[mode],
+                               pattern_names[pattern], op_names[op],
+                               chunk_len,
+                               (double)ns / (double)res.bytes,
+                               (double)res.calls * 1000.0 / (double)ns);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+typedef struct
+{
+    ringbuffer_t*   rb;
+    size_t          chunk_len;
+    size_t          total;
+} spsc_ctx_t;
+
+
+//------------------------------------------------------------------------------
+static void*
+spsc_producer(
+    void* arg)
+{
+    spsc_ctx_t* ctx = (spsc_ctx_t*)arg;
+
+    size_t written = 0;
+    while (written < ctx->total)
+    {
+        const size_t len = ringbuffer_write(ctx->rb, chunk, ctx->chunk_len);
+        if (0 == len)
+        {
+            sched_yield();
+        }
+        written += len;
+    }
+
+    return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+static void
+run_spsc(
+    size_t total)
+{
+    static const size_t chunk_sizes[] = { 16, 256, 1024 };
+
+    printf("\n%7s %9s %6s %9s\n", "cap", "layout", "chunk", "ns/byte");
+
+    for (size_t k = 0; k < sizeof(chunk_sizes)/sizeof(chunk_sizes[0]); k++)
+    {
+        static ringbuffer_t rb;
+        ringbuffer_initPow2(&rb, storage, BENCH_FIXED_CAPACITY);
+
+        spsc_ctx_t ctx = {
+            .rb        = &rb,
+            .chunk_len = chunk_sizes[k],
+            .total     = total,
+        };
+
+        const uint64_t start = get_time_ns();
+
+        pthread_t producer;
+        if (0 != pthread_create(&producer, NULL, spsc_producer, &ctx))
+        {
+            printf("could not create producer thread\n");
+            return;
+        }
+
+        size_t received = 0;
+        while (received < total)
+        {
+            void* ptr = NULL;
+            const size_t avail = ringbuffer_getReadPtr(&rb, &ptr);
+            if (0 == avail)
+            {
+                sched_yield();
+                continue;
+            }
+            received += ringbuffer_flush(&rb, avail);
+        }
+
+        pthread_join(producer, NULL);
+        const uint64_t ns = get_time_ns() - start;
+
+        printf("%7d %9s %6zu %9.3f\n",
+               BENCH_FIXED_CAPACITY,
+#if defined(RINGBUFFER_CACHE_LINE_SIZE)
+               "aligned",
+#else
+               "packed",
+#endif
+               chunk_sizes[k],
+               (double)ns / (double)received);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+int main(
+    int argc,
+    char* argv[])
+{
+    size_t total = BENCH_DEFAULT_BYTES;
+    if (argc > 1)
+    {
+        total = strtoul(argv[1], NULL, 0);
+        if (0 == total)
+        {
+            printf("usage: %s [bytes per run]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    run_single_thread(total);
+    run_spsc(total);
+
+    return 0;
+}
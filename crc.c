@@ -0,0 +1,126 @@
+/*
+ * CRC-32 and CRC-16 calculation over data streams
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#include "crc.h"
+
+#include <assert.h>
+#include <stdbool.h>
+
+#define CRC32_POLY  0xedb88320U // 0x04c11db7 reflected
+#define CRC16_POLY  0x8408U     // 0x1021 reflected
+
+// Table k holds the CRC of a byte followed by k zero bytes. Both CRCs use the
+// same tables layout, the CRC-16 values just have the upper bits cleared.
+typedef uint32_t crc_tables_t[8][256];
+
+static crc_tables_t crc32_tables;
+static crc_tables_t crc16_tables;
+static bool is_initialized = false;
+
+
+//------------------------------------------------------------------------------
+static void
+build_tables(
+    crc_tables_t tables,
+    uint32_t poly)
+{
+    for (unsigned int i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (unsigned int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? poly : 0);
+        }
+        tables[0][i] = crc;
+    }
+
+    for (unsigned int k = 1; k < 8; k++)
+    {
+        for (unsigned int i = 0; i < 256; i++)
+        {
+            const uint32_t prev = tables[k - 1][i];
+            tables[k][i] = (prev >> 8) ^ tables[0][prev & 0xff];
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Works for any reflected CRC with up to 32 bits.
+static uint32_t
+update_sliced(
+    const crc_tables_t tables,
+    uint32_t crc,
+    const uint8_t* buf,
+    size_t len)
+{
+    assert( is_initialized );
+
+    for (; len >= 8; len -= 8, buf += 8)
+    {
+        // Assemble the words byte by byte, so this works for any endianness.
+        const uint32_t lo = crc ^ ((uint32_t)buf[0]
+                                   | ((uint32_t)buf[1] << 8)
+                                   | ((uint32_t)buf[2] << 16)
+                                   | ((uint32_t)buf[3] << 24));
+
+        crc = tables[7][lo & 0xff]
+              ^ tables[6][(lo >> 8) & 0xff]
+              ^ tables[5][(lo >> 16) & 0xff]
+              ^ tables[4][lo >> 24]
+              ^ tables[3][buf[4]]
+              ^ tables[2][buf[5]]
+              ^ tables[1][buf[6]]
+              ^ tables[0][buf[7]];
+    }
+
+    for (; len > 0; len--, buf++)
+    {
+        crc = (crc >> 8) ^ tables[0][(crc ^ *buf) & 0xff];
+    }
+
+    return crc;
+}
+
+
+//------------------------------------------------------------------------------
+void
+crc_init(void)
+{
+    build_tables(crc32_tables, CRC32_POLY);
+    build_tables(crc16_tables, CRC16_POLY);
+    is_initialized = true;
+}
+
+
+//------------------------------------------------------------------------------
+uint32_t
+crc32_update(
+    uint32_t crc,
+    const uint8_t* buf,
+    size_t len)
+{
+    assert( (NULL != buf) || (0 == len) );
+
+    return update_sliced(crc32_tables, crc, buf, len);
+}
+
+
+//------------------------------------------------------------------------------
+uint16_t
+crc16_update(
+    uint16_t crc,
+    const uint8_t* buf,
+    size_t len)
+{
+    assert( (NULL != buf) || (0 == len) );
+
+    return (uint16_t)update_sliced(crc16_tables, crc, buf, len);
+}
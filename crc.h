@@ -0,0 +1,59 @@
+/*
+ * CRC-32 and CRC-16 calculation over data streams
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ *
+ * CRC-32 is the IEEE 802.3 CRC, CRC-16 is the X.25/HDLC CRC. Both are
+ * reflected, start with all bits set and invert the result. Data is processed
+ * eight bytes at a time with slicing-by-8 tables.
+ *
+ * A CRC over a stream is calculated with
+ *
+ *   crc = CRC32_INIT;
+ *   crc = crc32_update(crc, buf, len); // repeat for each chunk
+ *   crc = crc32_final(crc);
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CRC32_INIT  0xffffffffU
+#define CRC16_INIT  0xffffU
+
+// Build the tables, must be called once before any other function.
+void
+crc_init(void);
+
+uint32_t
+crc32_update(
+    uint32_t crc,
+    const uint8_t* buf,
+    size_t len);
+
+uint16_t
+crc16_update(
+    uint16_t crc,
+    const uint8_t* buf,
+    size_t len);
+
+//------------------------------------------------------------------------------
+static inline uint32_t
+crc32_final(
+    uint32_t crc)
+{
+    return ~crc;
+}
+
+//------------------------------------------------------------------------------
+static inline uint16_t
+crc16_final(
+    uint16_t crc)
+{
+    return (uint16_t)~crc;
+}
@@ -0,0 +1,137 @@
+/*
+ * Histogram with log2 buckets, constant memory and O(1) recording
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Bucket 0 holds the value 0, bucket n holds the values [2^(n-1), 2^n - 1]. The
+// last bucket also holds all larger values.
+#define HISTOGRAM_BUCKETS   32
+
+//------------------------------------------------------------------------------
+typedef struct
+{
+    size_t    buckets[HISTOGRAM_BUCKETS];
+    size_t    samples;
+    size_t    sum;
+    size_t    min;
+    size_t    max;
+} histogram_t;
+
+
+//------------------------------------------------------------------------------
+static inline void
+histogram_clear(
+    histogram_t* const self)
+{
+    assert( NULL != self );
+
+    memset(self, 0, sizeof(*self));
+}
+
+
+//------------------------------------------------------------------------------
+static inline size_t
+histogram_getBucket(
+    size_t value)
+{
+    if (0 == value)
+    {
+        return 0;
+    }
+
+    const size_t bucket = (sizeof(unsigned long) * 8)
+                          - (size_t)__builtin_clzl((unsigned long)value);
+
+    return (bucket < HISTOGRAM_BUCKETS) ? bucket : (HISTOGRAM_BUCKETS - 1);
+}
+
+
+//------------------------------------------------------------------------------
+static inline void
+histogram_record(
+    histogram_t* const self,
+    size_t value)
+{
+    assert( NULL != self );
+
+    self->buckets[histogram_getBucket(value)]++;
+
+    if ((0 == self->samples) || (value < self->min))
+    {
+        self->min = value;
+    }
+    if (value > self->max)
+    {
+        self->max = value;
+    }
+
+    self->samples++;
+    self->sum += value;
+}
+
+
+//------------------------------------------------------------------------------
+// Write a one line summary with all non-empty buckets into buf, the output is
+// truncated if buf is too small. Returns buf.
+static inline const char*
+histogram_format(
+    histogram_t* const self,
+    char* buf,
+    size_t len)
+{
+    assert( NULL != self );
+    assert( (NULL != buf) && (len > 0) );
+
+    int pos = snprintf(
+                buf, len, "n %zu, min %zu, max %zu, avg %zu |",
+                self->samples,
+                self->min,
+                self->max,
+                (0 == self->samples) ? 0 : self->sum / self->samples);
+
+    for (size_t i = 0; (i < HISTOGRAM_BUCKETS) && (pos >= 0); i++)
+    {
+        if ((size_t)pos >= len)
+        {
+            break;
+        }
+
+        if (0 == self->buckets[i])
+        {
+            continue;
+        }
+
+        const size_t lo = (0 == i) ? 0 : ((size_t)1 << (i - 1));
+        const size_t hi = (0 == i) ? 0 : ((size_t)1 << i) - 1;
+        if (HISTOGRAM_BUCKETS - 1 == i)
+        {
+            pos += snprintf(&buf[pos], len - (size_t)pos, " %zu+:%zu",
+                            lo, self->buckets[i]);
+        }
+        else if (lo == hi)
+        {
+            pos += snprintf(&buf[pos], len - (size_t)pos, " %zu:%zu",
+                            lo, self->buckets[i]);
+        }
+        else
+        {
+            pos += snprintf(&buf[pos], len - (size_t)pos, " %zu-%zu:%zu",
+                            lo, hi, self->buckets[i]);
+        }
+    }
+
+    return buf;
+}
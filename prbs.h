@@ -0,0 +1,209 @@
+/*
+ * Pseudo-random bit sequence (PRBS) generator and checker
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ *
+ * The sequences PRBS-7, PRBS-15, PRBS-23 and PRBS-31 follow the recurrence
+ * b[i] = b[i - order] ^ b[i - tap] with the taps from ITU-T O.150, without the
+ * inversion. Bits are packed into bytes LSB first, which is the order a UART
+ * sends them.
+ *
+ * Since no bit of the recurrence is closer than tap bits, tap bits are stepped
+ * at once. The checker predicts each bit from the received bits instead of a
+ * local generator, so it synchronizes itself after order bits and again after
+ * any loss of data. A single bit error is counted three times, once for the bit
+ * and once for each prediction it is used in. An all-zero history can't occur
+ * in the sequence, so a line stuck at zero is counted as errors, too.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+typedef struct
+{
+    unsigned int  order;
+    unsigned int  tap;
+    uint64_t      state;      // last order bits, bit 0 is the oldest
+    uint64_t      acc;        // bits not stepped yet, bit 0 is the oldest
+    unsigned int  acc_bits;
+    unsigned int  fill;       // bits in state, the checker needs order bits
+    size_t        bits;       // bits checked
+    size_t        errors;     // bit errors
+} prbs_t;
+
+
+//------------------------------------------------------------------------------
+// Returns false if there is no PRBS of this order.
+static inline bool
+prbs_init(
+    prbs_t* const self,
+    unsigned int order)
+{
+    assert( NULL != self );
+
+    unsigned int tap;
+    switch (order)
+    {
+    case 7:
+        tap = 6;
+        break;
+    case 15:
+        tap = 14;
+        break;
+    case 23:
+        tap = 18;
+        break;
+    case 31:
+        tap = 28;
+        break;
+    default:
+        return false;
+    }
+
+    self->order    = order;
+    self->tap      = tap;
+    self->state    = ((uint64_t)1 << order) - 1; // any non-zero seed works
+    self->acc      = 0;
+    self->acc_bits = 0;
+    self->fill     = 0;
+    self->bits     = 0;
+    self->errors   = 0;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Returns the next tap bits predicted from the state.
+static inline uint64_t
+prbs_predict(
+    const prbs_t* const self)
+{
+    const uint64_t mask = ((uint64_t)1 << self->tap) - 1;
+
+    return (self->state ^ (self->state >> (self->order - self->tap))) & mask;
+}
+
+
+//------------------------------------------------------------------------------
+static inline void
+prbs_shiftIn(
+    prbs_t* const self,
+    uint64_t bits)
+{
+    self->state = (self->state >> self->tap)
+                  | (bits << (self->order - self->tap));
+}
+
+
+//------------------------------------------------------------------------------
+static inline void
+prbs_generate(
+    prbs_t* const self,
+    uint8_t* buf,
+    size_t len)
+{
+    assert( NULL != self );
+    assert( (NULL != buf) || (0 == len) );
+
+    for (size_t i = 0; i < len; i++)
+    {
+        while (self->acc_bits < 8)
+        {
+            const uint64_t bits = prbs_predict(self);
+            prbs_shiftIn(self, bits);
+            self->acc |= bits << self->acc_bits;
+            self->acc_bits += self->tap;
+        }
+
+        buf[i] = (uint8_t)self->acc;
+        self->acc >>= 8;
+        self->acc_bits -= 8;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Check the received bits that are complete, returns the number of bit errors.
+static inline size_t
+prbs_checkAcc(
+    prbs_t* const self)
+{
+    const uint64_t mask = ((uint64_t)1 << self->tap) - 1;
+    size_t errors = 0;
+
+    while (self->acc_bits >= self->tap)
+    {
+        const uint64_t bits = self->acc & mask;
+        self->acc >>= self->tap;
+        self->acc_bits -= self->tap;
+
+        if (self->fill < self->order)
+        {
+            // The checker needs order bits of history first.
+            prbs_shiftIn(self, bits);
+            self->fill += self->tap;
+            continue;
+        }
+
+        errors += (size_t)__builtin_popcountll(bits ^ prbs_predict(self));
+        prbs_shiftIn(self, bits);
+        if (0 == self->state)
+        {
+            errors += self->tap;
+        }
+        self->bits += self->tap;
+    }
+
+    return errors;
+}
+
+
+//------------------------------------------------------------------------------
+// Check the received data, returns the number of bit errors found. Bits that do
+// not fill a whole step yet are checked with the next call.
+static inline size_t
+prbs_verify(
+    prbs_t* const self,
+    const uint8_t* buf,
+    size_t len)
+{
+    assert( NULL != self );
+    assert( (NULL != buf) || (0 == len) );
+
+    size_t errors = 0;
+    size_t i = 0;
+
+    // Take four bytes at once, the accumulator holds less than tap bits after
+    // each check.
+    for (; i + 4 <= len; i += 4)
+    {
+        const uint64_t word = (uint64_t)buf[i]
+                              | ((uint64_t)buf[i + 1] << 8)
+                              | ((uint64_t)buf[i + 2] << 16)
+                              | ((uint64_t)buf[i + 3] << 24);
+        self->acc |= word << self->acc_bits;
+        self->acc_bits += 32;
+        errors += prbs_checkAcc(self);
+    }
+
+    for (; i < len; i++)
+    {
+        self->acc |= (uint64_t)buf[i] << self->acc_bits;
+        self->acc_bits += 8;
+        errors += prbs_checkAcc(self);
+    }
+
+    self->errors += errors;
+
+    return errors;
+}
@@ -0,0 +1,109 @@
+/*
+ * Verifier for incrementing byte sequences
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ *
+ * The test data is a ramp, where each byte is the previous byte plus one and
+ * 0xff is followed by 0x00. ramp_findMismatch() checks a whole buffer against
+ * the expected ramp, working on machine words.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+//------------------------------------------------------------------------------
+// Returns the index of the first byte that does not match the ramp starting at
+// first, or len if all bytes match.
+static inline size_t
+ramp_findMismatchBytes(
+    const uint8_t* buf,
+    size_t len,
+    uint8_t first)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (buf[i] != (uint8_t)(first + i))
+        {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+
+//------------------------------------------------------------------------------
+// Add the bytes in a and b without carries from one byte into the next.
+static inline uint64_t
+ramp_addBytes(
+    uint64_t a,
+    uint64_t b)
+{
+    const uint64_t msb = 0x8080808080808080ULL;
+
+    return ((a & ~msb) + (b & ~msb)) ^ ((a ^ b) & msb);
+}
+
+
+//------------------------------------------------------------------------------
+static inline size_t
+ramp_findMismatchWords(
+    const uint8_t* buf,
+    size_t len,
+    uint8_t first)
+{
+    // The expected word is kept in memory order, adding 8 to each byte is
+    // independent of the endianness.
+    uint8_t init[sizeof(uint64_t)];
+    for (size_t i = 0; i < sizeof(init); i++)
+    {
+        init[i] = (uint8_t)(first + i);
+    }
+    uint64_t expected;
+    memcpy(&expected, init, sizeof(expected));
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+    {
+        uint64_t data;
+        memcpy(&data, &buf[i], sizeof(data));
+
+        const uint64_t diff = data ^ expected;
+        if (0 != diff)
+        {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+            return i + ((size_t)__builtin_clzll(diff) / 8);
+#else
+            return i + ((size_t)__builtin_ctzll(diff) / 8);
+#endif
+        }
+
+        expected = ramp_addBytes(expected, 0x0808080808080808ULL);
+    }
+
+    return i + ramp_findMismatchBytes(&buf[i], len - i, (uint8_t)(first + i));
+}
+
+
+//------------------------------------------------------------------------------
+// Returns the index of the first byte in buf that does not match the ramp
+// starting at first, or len if all bytes match.
+static inline size_t
+ramp_findMismatch(
+    const uint8_t* buf,
+    size_t len,
+    uint8_t first)
+{
+    assert( (NULL != buf) || (0 == len) );
+
+    return ramp_findMismatchWords(buf, len, first);
+}
@@ -1,5 +1,5 @@
 /*
- * Ring Buffer, not fully thread-safe
+ * Ring Buffer, lock-free for a single producer and a single consumer
  *
  * Copyright (C) 2020-2024, HENSOLDT Cyber GmbH
  * 
@@ -9,35 +9,372 @@
  */
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
+// If RINGBUFFER_CACHE_LINE_SIZE is defined, the consumer state and the producer
+// state of ringbuffer_t are placed in separate cache lines. This avoids false
+// sharing when the producer and the consumer run on different cores.
+#if defined(RINGBUFFER_CACHE_LINE_SIZE)
+#define RINGBUFFER_CACHE_ALIGNED \
+    __attribute__((aligned(RINGBUFFER_CACHE_LINE_SIZE)))
+#else
+#define RINGBUFFER_CACHE_ALIGNED
+#endif
+
+// If RINGBUFFER_STATS is defined, ringbuffer_t keeps counters about its usage
+// that can be queried with ringbuffer_getStats(). Otherwise, the counting is
+// compiled out.
+
 //------------------------------------------------------------------------------
+// The indices head and tail run in the range [0, 2 * capacity), so a full and an
+// empty buffer can be told apart without a shared fill counter. The consumer is
+// the only one that modifies head, the producer is the only one that modifies
+// tail. This allows one producer thread and one consumer thread to use the
+// buffer concurrently without any locking. Functions that modify both indices,
+// like ringbuffer_init() and ringbuffer_clear(), are not thread-safe.
+// If the capacity is a power of two, ringbuffer_initPow2() can be used instead
+// of ringbuffer_init(). Then the indices are free-running and a position is
+// obtained by masking, which avoids the integer divisions that are expensive on
+// some platforms or even end up in a libgcc call.
+// A mirrored buffer, see ringbuffer_initMirrored(), uses twice the capacity as
+// backing storage and guarantees that used and free space are always contiguous.
+// RINGBUFFER_DECLARE() creates a buffer type with a capacity that is known at
+// compile time, so the compiler can fold the index arithmetic and checks.
+
+typedef enum
+{
+    RINGBUFFER_MIRROR_NONE = 0, // data wraps around at the end of the buffer
+    RINGBUFFER_MIRROR_COPY,     // second half is kept up to date by copying
+    RINGBUFFER_MIRROR_MAPPED,   // second half is the first half mapped again
+} ringbuffer_mirror_t;
+
+// Usage counters, see ringbuffer_getStats().
+typedef struct
+{
+    size_t    bytes_in;
+    size_t    bytes_out;
+    size_t    peak_used;        // highest fill level seen by the producer
+    size_t    wraps;            // number of times the write position wrapped
+    size_t    writes_truncated; // writes that did not fit completely
+} ringbuffer_stats_t;
+
+// A contiguous part of the buffer, see ringbuffer_getReadSpans() and
+// ringbuffer_getWriteSpans().
 typedef struct
 {
+    uint8_t*  ptr;
+    size_t    len;
+} ringbuffer_span_t;
+
+// The parameters that define how indices map to positions in the buffer. The
+// operations take them by value, so a constant layout from a buffer type
+// created by RINGBUFFER_DECLARE() propagates into the inlined code.
+typedef struct
+{
+    size_t               capacity;
+    bool                 is_pow2;
+    ringbuffer_mirror_t  mirror;
+} ringbuffer_layout_t;
+
+typedef struct
+{
+    // not modified after initialization, shared by both sides
     uint8_t*  buffer;
     size_t    capacity;
-    size_t    head; // position where data starts
-    size_t    used;
+    bool      is_pow2; // capacity is a power of two, indices are free-running
+    ringbuffer_mirror_t  mirror;
+
+    size_t    head RINGBUFFER_CACHE_ALIGNED; // read index, owned by the consumer
+#if defined(RINGBUFFER_STATS)
+    size_t    stats_bytes_out;
+#endif
+
+    size_t    tail RINGBUFFER_CACHE_ALIGNED; // write index, owned by the producer
+#if defined(RINGBUFFER_STATS)
+    size_t    stats_bytes_in;
+    size_t    stats_peak_used;
+    size_t    stats_wraps;
+    size_t    stats_writes_truncated;
+#endif
 } ringbuffer_t;
 
+
+//------------------------------------------------------------------------------
+// Load the index owned by the other side. The acquire ordering guarantees that
+// all buffer accesses the other side did before publishing the index are
+// visible.
+static inline size_t
+ringbuffer_loadIdx(
+    const size_t* idx)
+{
+    return __atomic_load_n(idx, __ATOMIC_ACQUIRE);
+}
+
+
+//------------------------------------------------------------------------------
+// Publish an index. The release ordering guarantees that the other side sees
+// all buffer accesses done before.
+static inline void
+ringbuffer_storeIdx(
+    size_t* idx,
+    size_t val)
+{
+    __atomic_store_n(idx, val, __ATOMIC_RELEASE);
+}
+
+
+//------------------------------------------------------------------------------
+// An index can only be modified by its owner, so the owner can read it without
+// any ordering constraints.
+static inline size_t
+ringbuffer_loadOwnIdx(
+    const size_t* idx)
+{
+    return __atomic_load_n(idx, __ATOMIC_RELAXED);
+}
+
+
+//------------------------------------------------------------------------------
+// The ringbuffer_implXXX() functions take the layout explicitly. They must be
+// inlined, otherwise a constant layout can't be folded into the code.
+#define RINGBUFFER_IMPL static inline __attribute__((always_inline))
+
+
+//------------------------------------------------------------------------------
+static inline ringbuffer_layout_t
+ringbuffer_getLayout(
+    ringbuffer_t* const self)
+{
+    assert( NULL != self );
+
+    const ringbuffer_layout_t layout = {
+        .capacity = self->capacity,
+        .is_pow2  = self->is_pow2,
+        .mirror   = self->mirror,
+    };
+
+    return layout;
+}
+
+
+//------------------------------------------------------------------------------
+RINGBUFFER_IMPL size_t
+ringbuffer_getPos(
+    const ringbuffer_layout_t layout,
+    size_t idx)
+{
+    assert( 0 != layout.capacity );
+
+    if (layout.is_pow2)
+    {
+        return idx & (layout.capacity - 1);
+    }
+
+    assert( idx < 2 * layout.capacity );
+    return idx % layout.capacity;
+}
+
+
+//------------------------------------------------------------------------------
+RINGBUFFER_IMPL size_t
+ringbuffer_advanceIdx(
+    const ringbuffer_layout_t layout,
+    size_t idx,
+    size_t len)
+{
+    assert( 0 != layout.capacity );
+    assert( len <= layout.capacity );
+
+    if (layout.is_pow2)
+    {
+        // Free-running, an overflow is fine because the capacity divides the
+        // range of size_t.
+        return idx + len;
+    }
+
+    return (idx + len) % (2 * layout.capacity);
+}
+
+
+//------------------------------------------------------------------------------
+RINGBUFFER_IMPL size_t
+ringbuffer_getUsedFromIdx(
+    const ringbuffer_layout_t layout,
+    size_t head,
+    size_t tail)
+{
+    // Free-running indices can simply be subtracted. Otherwise both indices are
+    // in the range [0, 2 * capacity), so adding the range once is enough to
+    // avoid a negative result.
+    const size_t used = (layout.is_pow2 || (tail >= head))
+                        ? (tail - head)
+                        : (tail + 2 * layout.capacity - head);
+
+    // sanity check
+    assert( used <= layout.capacity );
+
+    return used;
+}
+
+//------------------------------------------------------------------------------
+RINGBUFFER_IMPL size_t
+ringbuffer_implGetCappedLen(
+    const ringbuffer_layout_t layout,
+    size_t pos,
+    size_t len)
+{
+    if (pos >= layout.capacity)
+    {
+        assert( pos < layout.capacity );
+        return 0;
+    }
+
+    // In a mirrored buffer, the second half continues the first half.
+    size_t len_remaining = ((RINGBUFFER_MIRROR_NONE == layout.mirror) ? 1 : 2)
+                           * layout.capacity - pos;
+    return (len > len_remaining) ? len_remaining : len;
+}
+
+
 //------------------------------------------------------------------------------
 static inline size_t
 ringbuffer_getCappedLen(
     ringbuffer_t* const self,
     size_t pos,
     size_t len)
+{
+    return ringbuffer_implGetCappedLen(ringbuffer_getLayout(self), pos, len);
+}
+
+
+//------------------------------------------------------------------------------
+// Update the copy of the data written at pos in a mirrored buffer. Data that
+// went into the second half is copied to the start. Data written behind the
+// head can be read via the second half, so it is copied there. Writing behind
+// a stale head just creates an unnecessary copy, so the producer does not need
+// an up to date head.
+RINGBUFFER_IMPL void
+ringbuffer_updateMirror(
+    ringbuffer_t* const self,
+    const ringbuffer_layout_t layout,
+    size_t pos,
+    size_t len,
+    size_t pos_head,
+    size_t used)
 {
     assert( NULL != self );
+    assert( pos < layout.capacity );
 
-    if (pos >= self->capacity)
+    if (RINGBUFFER_MIRROR_COPY != layout.mirror)
+    {
+        return;
+    }
+
+    if (pos + len > layout.capacity)
+    {
+        memcpy(self->buffer,
+               &self->buffer[layout.capacity],
+               pos + len - layout.capacity);
+    }
+    else if ((used > 0) && (pos < pos_head))
+    {
+        memcpy(&self->buffer[layout.capacity + pos], &self->buffer[pos], len);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Account data added by the producer, where used is the fill level before.
+RINGBUFFER_IMPL void
+ringbuffer_statsProduced(
+    ringbuffer_t* const self,
+    const ringbuffer_layout_t layout,
+    size_t pos,
+    size_t len,
+    size_t used)
+{
+#if defined(RINGBUFFER_STATS)
+    self->stats_bytes_in += len;
+    if (used + len > self->stats_peak_used)
+    {
+        self->stats_peak_used = used + len;
+    }
+    if (pos + len >= layout.capacity)
+    {
+        self->stats_wraps++;
+    }
+#else
+    (void)self;
+    (void)layout;
+    (void)pos;
+    (void)len;
+    (void)used;
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+// Account a write that did not fit completely.
+RINGBUFFER_IMPL void
+ringbuffer_statsTruncated(
+    ringbuffer_t* const self)
+{
+#if defined(RINGBUFFER_STATS)
+    self->stats_writes_truncated++;
+#else
+    (void)self;
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+// Account data removed by the consumer.
+RINGBUFFER_IMPL void
+ringbuffer_statsConsumed(
+    ringbuffer_t* const self,
+    size_t len)
+{
+#if defined(RINGBUFFER_STATS)
+    self->stats_bytes_out += len;
+#else
+    (void)self;
+    (void)len;
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+// Split len bytes starting at pos into the part up to the end of the buffer and
+// the part that wraps around to the start. Returns the number of spans used.
+RINGBUFFER_IMPL size_t
+ringbuffer_getSpans(
+    ringbuffer_t* const self,
+    const ringbuffer_layout_t layout,
+    size_t pos,
+    size_t len,
+    ringbuffer_span_t spans[2])
+{
+    assert( NULL != self );
+    assert( NULL != spans );
+
+    spans[0].ptr = self->buffer;
+    spans[0].len = 0;
+    spans[1].ptr = self->buffer;
+    spans[1].len = 0;
+
+    if (0 == len)
     {
-        assert( pos < self->capacity );
         return 0;
     }
 
-    size_t len_remaining = self->capacity - pos;
-    return (len > len_remaining) ? len_remaining : len;
+    spans[0].ptr = &self->buffer[pos];
+    spans[0].len = ringbuffer_implGetCappedLen(layout, pos, len);
+    spans[1].len = len - spans[0].len;
+
+    return (0 == spans[1].len) ? 1 : 2;
 }
 
 
@@ -49,7 +386,7 @@ ringbuffer_clear(
     assert( NULL != self );
 
     self->head = 0;
-    self->used = 0;
+    self->tail = 0;
 }
 
 
@@ -65,18 +402,26 @@ ringbuffer_getCapacity(
 
 
 //------------------------------------------------------------------------------
-static inline size_t
-ringbuffer_getUsed(
-    ringbuffer_t* const self)
+RINGBUFFER_IMPL size_t
+ringbuffer_implGetUsed(
+    ringbuffer_t* const self,
+    const ringbuffer_layout_t layout)
 {
     assert( NULL != self );
 
-    const size_t used = self->used; // read only once to guarantee consistency
+    return ringbuffer_getUsedFromIdx(
+                layout,
+                ringbuffer_loadIdx(&self->head),
+                ringbuffer_loadIdx(&self->tail));
+}
 
-    // sanity check
-    assert( used <= self->capacity );
 
-    return used;
+//------------------------------------------------------------------------------
+static inline size_t
+ringbuffer_getUsed(
+    ringbuffer_t* const self)
+{
+    return ringbuffer_implGetUsed(self, ringbuffer_getLayout(self));
 }
 
 
@@ -85,14 +430,7 @@ static inline bool
 ringbuffer_isEmpty(
     ringbuffer_t* const self)
 {
-    assert( NULL != self );
-
-    const size_t used = self->used; // read only once to guarantee consistency
-
-    // sanity check
-    assert( used <= self->capacity );
-
-    return (0 == used);
+    return (0 == ringbuffer_getUsed(self));
 }
 
 
@@ -101,14 +439,7 @@ static inline size_t
 ringbuffer_getFree(
     ringbuffer_t* const self)
 {
-    assert( NULL != self );
-
-    const size_t used = self->used; // read only once to guarantee consistency
-
-    // sanity check
-    assert( used <= self->capacity );
-
-    return self->capacity - used;
+    return ringbuffer_getCapacity(self) - ringbuffer_getUsed(self);
 }
 
 
@@ -117,14 +448,33 @@ static inline bool
 ringbuffer_isFull(
     ringbuffer_t* const self)
 {
-    assert( NULL != self );
-
-    const size_t used = self->used; // read only once to guarantee consistency
+    return (ringbuffer_getCapacity(self) == ringbuffer_getUsed(self));
+}
 
-    // sanity check
-    assert( used <= self->capacity );
 
-    return (self->capacity == used);
+//------------------------------------------------------------------------------
+// Get the usage counters. Returns false if they are not available because
+// RINGBUFFER_STATS is not defined. Each counter is only updated by one side,
+// so while the other side is active, they may be slightly inconsistent.
+static inline bool
+ringbuffer_getStats(
+    ringbuffer_t* const self,
+    ringbuffer_stats_t* stats)
+{
+    assert( NULL != self );
+    assert( NULL != stats );
+
+#if defined(RINGBUFFER_STATS)
+    stats->bytes_in         = self->stats_bytes_in;
+    stats->bytes_out        = self->stats_bytes_out;
+    stats->peak_used        = self->stats_peak_used;
+    stats->wraps            = self->stats_wraps;
+    stats->writes_truncated = self->stats_writes_truncated;
+    return true;
+#else
+    memset(stats, 0, sizeof(*stats));
+    return false;
+#endif
 }
 
 
@@ -140,51 +490,118 @@ ringbuffer_init(
 
     self->buffer = (uint8_t*)buffer;
     self->capacity = len;
+    self->is_pow2 = false;
+    self->mirror = RINGBUFFER_MIRROR_NONE;
+
+#if defined(RINGBUFFER_STATS)
+    self->stats_bytes_in = 0;
+    self->stats_bytes_out = 0;
+    self->stats_peak_used = 0;
+    self->stats_wraps = 0;
+    self->stats_writes_truncated = 0;
+#endif
 
     ringbuffer_clear(self);
 }
 
 
 //------------------------------------------------------------------------------
-static inline size_t
-ringbuffer_write(
+// Initialize a buffer whose capacity is a power of two, so masking can be used
+// instead of modulo operations. Fails if len is not a power of two.
+static inline bool
+ringbuffer_initPow2(
     ringbuffer_t* const self,
+    void* buffer,
+    size_t len)
+{
+    assert( NULL != self );
+
+    if ((0 == len) || (0 != (len & (len - 1))))
+    {
+        return false;
+    }
+
+    ringbuffer_init(self, buffer, len);
+    self->is_pow2 = true;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Initialize a mirrored buffer, where buffer must provide 2 * len bytes. The
+// second half continues the first half, so all used data and all free space
+// can always be accessed as one contiguous block. If the caller has mapped the
+// same memory twice back to back, RINGBUFFER_MIRROR_MAPPED makes this free,
+// RINGBUFFER_MIRROR_COPY is the fallback that maintains the second half by
+// copying. Power-of-two indexing is used if len allows it.
+static inline void
+ringbuffer_initMirrored(
+    ringbuffer_t* const self,
+    void* buffer,
+    size_t len,
+    ringbuffer_mirror_t mirror)
+{
+    assert( NULL != self );
+
+    if (!ringbuffer_initPow2(self, buffer, len))
+    {
+        ringbuffer_init(self, buffer, len);
+    }
+
+    self->mirror = mirror;
+}
+
+
+//------------------------------------------------------------------------------
+RINGBUFFER_IMPL size_t
+ringbuffer_implWrite(
+    ringbuffer_t* const self,
+    const ringbuffer_layout_t layout,
     const void* src,
     size_t len)
 {
     assert( NULL != self );
     assert( (0 == len) || (NULL != src) );
 
-    const size_t used = self->used; // read only once to guarantee consistency
-    assert( used <= self->capacity );
+    const size_t tail = ringbuffer_loadOwnIdx(&self->tail);
+    const size_t head = ringbuffer_loadIdx(&self->head);
+    const size_t used = ringbuffer_getUsedFromIdx(layout, head, tail);
 
-    const size_t free = self->capacity - used;
+    const size_t free = layout.capacity - used;
     if (len > free)
     {
+        ringbuffer_statsTruncated(self);
         len = free;
     }
 
     if (len > 0)
     {
-        const size_t pos_head = self->head;
-        assert( pos_head < self->capacity );
+        // the capacity can't be 0 here, because len is greater 0
+        const size_t pos_free = ringbuffer_getPos(layout, tail);
 
-        // self->capacity can't be 0 here, because len is greater 0
-        assert( 0 != self->capacity );
-        const size_t pos_free = (pos_head + used) % self->capacity;
-
-        const size_t len1 = ringbuffer_getCappedLen(self, pos_free, len);
+        const size_t len1 = ringbuffer_implGetCappedLen(layout, pos_free, len);
         assert(len1 > 0);
         memcpy(&self->buffer[pos_free], src, len1);
         if (len > len1)
         {
-            assert(pos_free + len1 == self->capacity);
+            assert(pos_free + len1 == layout.capacity);
             memcpy(self->buffer, &((uint8_t*)src)[len1], len - len1);
         }
 
-        // this does read-copy-write and thus it's not thread-safe
-        self->used += len;
-        assert( self->used <= self->capacity );
+        ringbuffer_updateMirror(
+            self,
+            layout,
+            pos_free,
+            len,
+            ringbuffer_getPos(layout, head),
+            used);
+
+        ringbuffer_statsProduced(self, layout, pos_free, len, used);
+
+        // Publish the data. The consumer may see the old tail until then, this
+        // just means less data is available.
+        ringbuffer_storeIdx(&self->tail, ringbuffer_advanceIdx(layout, tail, len));
     }
 
     return len;
@@ -192,17 +609,166 @@ ringbuffer_write(
 
 
 //------------------------------------------------------------------------------
-// read or flush if dst is NULL
+// Must be called from the producer side only.
 static inline size_t
-ringbuffer_read(
+ringbuffer_write(
+    ringbuffer_t* const self,
+    const void* src,
+    size_t len)
+{
+    return ringbuffer_implWrite(self, ringbuffer_getLayout(self), src, len);
+}
+
+
+//------------------------------------------------------------------------------
+// Get pointer within the FIFO to free space, which allows the producer to fill
+// it without an intermediate copy. Call ringbuffer_commit() once the data has
+// been written, so this part of the buffer is marked as used. Must be called
+// from the producer side only. For a mirrored buffer, this always covers all
+// free space.
+RINGBUFFER_IMPL size_t
+ringbuffer_implGetWritePtr(
     ringbuffer_t* const self,
+    const ringbuffer_layout_t layout,
+    void** ptr)
+{
+    assert( NULL != self );
+    assert( NULL != ptr );
+
+    const size_t tail = ringbuffer_loadOwnIdx(&self->tail);
+    const size_t head = ringbuffer_loadIdx(&self->head);
+    const size_t used = ringbuffer_getUsedFromIdx(layout, head, tail);
+
+    const size_t free = layout.capacity - used;
+    if (0 == free)
+    {
+        *ptr = self->buffer;
+        return 0;
+    }
+
+    const size_t pos_free = ringbuffer_getPos(layout, tail);
+
+    *ptr = &self->buffer[pos_free];
+    return ringbuffer_implGetCappedLen(layout, pos_free, free);
+}
+
+
+//------------------------------------------------------------------------------
+static inline size_t
+ringbuffer_getWritePtr(
+    ringbuffer_t* const self,
+    void** ptr)
+{
+    return ringbuffer_implGetWritePtr(self, ringbuffer_getLayout(self), ptr);
+}
+
+
+//------------------------------------------------------------------------------
+// Mark data written via ringbuffer_getWritePtr() or ringbuffer_getWriteSpans()
+// as used. Must be called from the producer side only.
+RINGBUFFER_IMPL size_t
+ringbuffer_implCommit(
+    ringbuffer_t* const self,
+    const ringbuffer_layout_t layout,
+    size_t len)
+{
+    assert( NULL != self );
+
+    const size_t tail = ringbuffer_loadOwnIdx(&self->tail);
+    const size_t head = ringbuffer_loadIdx(&self->head);
+    const size_t used = ringbuffer_getUsedFromIdx(layout, head, tail);
+
+    const size_t free = layout.capacity - used;
+    if (len > free)
+    {
+        assert( len <= free );
+        len = free;
+    }
+
+    if (len > 0)
+    {
+        // the capacity can't be 0 here, because len is greater 0
+        const size_t pos_free = ringbuffer_getPos(layout, tail);
+
+        ringbuffer_updateMirror(
+            self,
+            layout,
+            pos_free,
+            len,
+            ringbuffer_getPos(layout, head),
+            used);
+
+        ringbuffer_statsProduced(self, layout, pos_free, len, used);
+
+        ringbuffer_storeIdx(&self->tail, ringbuffer_advanceIdx(layout, tail, len));
+    }
+
+    return len;
+}
+
+
+//------------------------------------------------------------------------------
+static inline size_t
+ringbuffer_commit(
+    ringbuffer_t* const self,
+    size_t len)
+{
+    return ringbuffer_implCommit(self, ringbuffer_getLayout(self), len);
+}
+
+
+//------------------------------------------------------------------------------
+// Get all free space as up to two spans, so the producer can fill it in one
+// pass. Call ringbuffer_commit() with the total length written, the second span
+// must only be used once the first span is full. Returns the total free space.
+// Must be called from the producer side only.
+RINGBUFFER_IMPL size_t
+ringbuffer_implGetWriteSpans(
+    ringbuffer_t* const self,
+    const ringbuffer_layout_t layout,
+    ringbuffer_span_t spans[2])
+{
+    assert( NULL != self );
+
+    const size_t tail = ringbuffer_loadOwnIdx(&self->tail);
+    const size_t head = ringbuffer_loadIdx(&self->head);
+    const size_t free = layout.capacity
+                        - ringbuffer_getUsedFromIdx(layout, head, tail);
+
+    ringbuffer_getSpans(
+        self,
+        layout,
+        (0 == free) ? 0 : ringbuffer_getPos(layout, tail),
+        free,
+        spans);
+
+    return free;
+}
+
+
+//------------------------------------------------------------------------------
+static inline size_t
+ringbuffer_getWriteSpans(
+    ringbuffer_t* const self,
+    ringbuffer_span_t spans[2])
+{
+    return ringbuffer_implGetWriteSpans(self, ringbuffer_getLayout(self), spans);
+}
+
+
+//------------------------------------------------------------------------------
+RINGBUFFER_IMPL size_t
+ringbuffer_implRead(
+    ringbuffer_t* const self,
+    const ringbuffer_layout_t layout,
     void* dst,
     size_t len)
 {
     assert( NULL != self );
 
-    const size_t used = self->used; // read only once to guarantee consistency
-    assert( used <= self->capacity );
+    const size_t head = ringbuffer_loadOwnIdx(&self->head);
+    const size_t tail = ringbuffer_loadIdx(&self->tail);
+    const size_t used = ringbuffer_getUsedFromIdx(layout, head, tail);
 
     if (len > used)
     {
@@ -211,30 +777,26 @@ ringbuffer_read(
 
     if (len > 0)
     {
-        const size_t pos_head = self->head;
-        assert( pos_head < self->capacity );
+        // the capacity can't be 0 here, because len is greater 0
+        const size_t pos_head = ringbuffer_getPos(layout, head);
 
         if (NULL != dst)
         {
-            const size_t len1 = ringbuffer_getCappedLen(self, pos_head, len);
+            const size_t len1 = ringbuffer_implGetCappedLen(layout, pos_head, len);
             assert(len1 > 0);
             memcpy(dst, &self->buffer[pos_head], len1);
             if (len > len1)
             {
-                assert(pos_head + len1 == self->capacity);
+                assert(pos_head + len1 == layout.capacity);
                 memcpy(&((uint8_t*)dst)[len1], self->buffer, len - len1);
             }
         }
 
-        // self->capacity can't be 0 here, because len is greater 0
-        assert( 0 != self->capacity );
-        self->head = (pos_head + len) % self->capacity;
+        ringbuffer_statsConsumed(self, len);
 
-        // we've adjusted len before, so the subtraction is safe. Furthermore,
-        // a write shall only increase the amount of data, but never reduce it,
-        // so this can't get negative. However, this is still not thread safe,
-        // because it does a read-modify-write.
-        self->used -= len;
+        // Release the space. The producer may see the old head until then,
+        // this just means less space is available.
+        ringbuffer_storeIdx(&self->head, ringbuffer_advanceIdx(layout, head, len));
     }
 
     return len;
@@ -242,7 +804,20 @@ ringbuffer_read(
 
 
 //------------------------------------------------------------------------------
-// flush data
+// Read or flush if dst is NULL. Must be called from the consumer side only.
+static inline size_t
+ringbuffer_read(
+    ringbuffer_t* const self,
+    void* dst,
+    size_t len)
+{
+    return ringbuffer_implRead(self, ringbuffer_getLayout(self), dst, len);
+}
+
+
+//------------------------------------------------------------------------------
+// Flush data. This is also the bulk consume operation for data accessed via
+// ringbuffer_getReadPtr() or ringbuffer_getReadSpans().
 static inline size_t
 ringbuffer_flush(
     ringbuffer_t* const self,
@@ -256,21 +831,192 @@ ringbuffer_flush(
 //------------------------------------------------------------------------------
 // Get pointer within the FIFO with data to read, which allows doing zero-copy
 // operations. Call ringbuffer_flush() once the data has been processed, so this
-// part of the buffer is marked as free again.
-static inline size_t
-ringbuffer_getReadPtr(
+// part of the buffer is marked as free again. Must be called from the consumer
+// side only. For a mirrored buffer, this always covers all used data.
+RINGBUFFER_IMPL size_t
+ringbuffer_implGetReadPtr(
     ringbuffer_t* const self,
+    const ringbuffer_layout_t layout,
     void** ptr)
 {
     assert( NULL != self );
     assert( NULL != ptr );
 
-    const size_t used = self->used; // read only once to guarantee consistency
-    assert( used <= self->capacity );
+    const size_t head = ringbuffer_loadOwnIdx(&self->head);
+    const size_t tail = ringbuffer_loadIdx(&self->tail);
+    const size_t used = ringbuffer_getUsedFromIdx(layout, head, tail);
 
-    const size_t pos_head = self->head;
-    assert( pos_head < self->capacity );
+    if (0 == used)
+    {
+        *ptr = self->buffer;
+        return 0;
+    }
+
+    const size_t pos_head = ringbuffer_getPos(layout, head);
 
     *ptr = &self->buffer[pos_head];
-    return ringbuffer_getCappedLen(self, pos_head, used);
+    return ringbuffer_implGetCappedLen(layout, pos_head, used);
+}
+
+
+//------------------------------------------------------------------------------
+static inline size_t
+ringbuffer_getReadPtr(
+    ringbuffer_t* const self,
+    void** ptr)
+{
+    return ringbuffer_implGetReadPtr(self, ringbuffer_getLayout(self), ptr);
+}
+
+
+//------------------------------------------------------------------------------
+// Get all used data as up to two spans, so the consumer can process it in one
+// pass. Call ringbuffer_flush() once with the total length processed. Returns
+// the total amount of used data. Must be called from the consumer side only.
+RINGBUFFER_IMPL size_t
+ringbuffer_implGetReadSpans(
+    ringbuffer_t* const self,
+    const ringbuffer_layout_t layout,
+    ringbuffer_span_t spans[2])
+{
+    assert( NULL != self );
+
+    const size_t head = ringbuffer_loadOwnIdx(&self->head);
+    const size_t tail = ringbuffer_loadIdx(&self->tail);
+    const size_t used = ringbuffer_getUsedFromIdx(layout, head, tail);
+
+    ringbuffer_getSpans(
+        self,
+        layout,
+        (0 == used) ? 0 : ringbuffer_getPos(layout, head),
+        used,
+        spans);
+
+    return used;
+}
+
+
+//------------------------------------------------------------------------------
+static inline size_t
+ringbuffer_getReadSpans(
+    ringbuffer_t* const self,
+    ringbuffer_span_t spans[2])
+{
+    return ringbuffer_implGetReadSpans(self, ringbuffer_getLayout(self), spans);
 }
+
+
+//------------------------------------------------------------------------------
+// Declare a buffer type name_t with a fixed capacity of N bytes and embedded
+// storage, together with the functions name_init(), name_getUsed(),
+// name_getFree(), name_isEmpty(), name_write(), name_getWritePtr(),
+// name_commit(), name_getWriteSpans(), name_read(), name_flush(),
+// name_getReadPtr() and name_getReadSpans(). They behave like the ringbuffer_t
+// functions, but the capacity is a compile time constant, so the compiler can
+// fold the index arithmetic and the bounds checks. The member rb is a regular
+// ringbuffer_t that can be used with all other ringbuffer_xxx() functions.
+#define RINGBUFFER_DECLARE(name, N) \
+    RINGBUFFER_DECLARE_WITH_MIRROR(name, N, RINGBUFFER_MIRROR_NONE)
+
+// Same as RINGBUFFER_DECLARE(), but the buffer is mirrored by copying.
+#define RINGBUFFER_DECLARE_MIRRORED(name, N) \
+    RINGBUFFER_DECLARE_WITH_MIRROR(name, N, RINGBUFFER_MIRROR_COPY)
+
+#define RINGBUFFER_DECLARE_WITH_MIRROR(name, N, MIRROR) \
+    \
+    _Static_assert((N) > 0, "capacity of " #name " must not be 0"); \
+    \
+    typedef struct \
+    { \
+        ringbuffer_t  rb; \
+        uint8_t       storage[((MIRROR) == RINGBUFFER_MIRROR_NONE ? 1 : 2) * (N)] \
+                          RINGBUFFER_CACHE_ALIGNED; \
+    } name##_t; \
+    \
+    static inline ringbuffer_layout_t \
+    name##_getLayout(void) \
+    { \
+        const ringbuffer_layout_t layout = { \
+            .capacity = (N), \
+            .is_pow2  = (0 == ((N) & ((N) - 1))), \
+            .mirror   = (MIRROR), \
+        }; \
+        return layout; \
+    } \
+    \
+    static inline void \
+    name##_init(name##_t* const self) \
+    { \
+        assert( NULL != self ); \
+        ringbuffer_init(&self->rb, self->storage, (N)); \
+        self->rb.is_pow2 = name##_getLayout().is_pow2; \
+        self->rb.mirror = (MIRROR); \
+    } \
+    \
+    static inline size_t \
+    name##_getUsed(name##_t* const self) \
+    { \
+        return ringbuffer_implGetUsed(&self->rb, name##_getLayout()); \
+    } \
+    \
+    static inline size_t \
+    name##_getFree(name##_t* const self) \
+    { \
+        return (N) - name##_getUsed(self); \
+    } \
+    \
+    static inline bool \
+    name##_isEmpty(name##_t* const self) \
+    { \
+        return (0 == name##_getUsed(self)); \
+    } \
+    \
+    static inline size_t \
+    name##_write(name##_t* const self, const void* src, size_t len) \
+    { \
+        return ringbuffer_implWrite(&self->rb, name##_getLayout(), src, len); \
+    } \
+    \
+    static inline size_t \
+    name##_getWritePtr(name##_t* const self, void** ptr) \
+    { \
+        return ringbuffer_implGetWritePtr(&self->rb, name##_getLayout(), ptr); \
+    } \
+    \
+    static inline size_t \
+    name##_commit(name##_t* const self, size_t len) \
+    { \
+        return ringbuffer_implCommit(&self->rb, name##_getLayout(), len); \
+    } \
+    \
+    static inline size_t \
+    name##_getWriteSpans(name##_t* const self, ringbuffer_span_t spans[2]) \
+    { \
+        return ringbuffer_implGetWriteSpans( \
+                    &self->rb, name##_getLayout(), spans); \
+    } \
+    \
+    static inline size_t \
+    name##_read(name##_t* const self, void* dst, size_t len) \
+    { \
+        return ringbuffer_implRead(&self->rb, name##_getLayout(), dst, len); \
+    } \
+    \
+    static inline size_t \
+    name##_flush(name##_t* const self, size_t len) \
+    { \
+        return ringbuffer_implRead(&self->rb, name##_getLayout(), NULL, len); \
+    } \
+    \
+    static inline size_t \
+    name##_getReadPtr(name##_t* const self, void** ptr) \
+    { \
+        return ringbuffer_implGetReadPtr(&self->rb, name##_getLayout(), ptr); \
+    } \
+    \
+    static inline size_t \
+    name##_getReadSpans(name##_t* const self, ringbuffer_span_t spans[2]) \
+    { \
+        return ringbuffer_implGetReadSpans( \
+                    &self->rb, name##_getLayout(), spans); \
+    }
@@ -40,3 +40,24 @@
 // UART
 //-----------------------------------------------------------------------------
 #define Uart_INPUT_FIFO_DATAPORT_SIZE 4096
+
+// Baud rate the test runs with, the throughput is reported relative to it. With
+// 8N1 framing, each byte takes 10 bits on the line.
+#define UART_TEST_BAUD_RATE         115200
+
+// Full-duplex loopback test, TX and RX must be connected externally. A second
+// thread in the tester sends the test pattern while the RX test verifies the
+// echoed data. This also adds the thread and its connection to the system.
+//#define UART_TEST_LOOPBACK
+
+//-----------------------------------------------------------------------------
+// Ring Buffer
+//-----------------------------------------------------------------------------
+// Keep producer and consumer state in separate cache lines. All supported
+// platforms use 64 byte lines, except the Cortex-A9 with 32 byte lines, where
+// this just wastes a bit of memory.
+#define RINGBUFFER_CACHE_LINE_SIZE 64
+
+// Count peak fill level, wrap-arounds and truncated writes. This costs a few
+// additions per write and read, comment it out to compile this out.
+#define RINGBUFFER_STATS
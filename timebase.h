@@ -0,0 +1,89 @@
+/*
+ * Free-running time base
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ *
+ * Reads a free-running counter directly from user space, so there is no need
+ * for a timer server:
+ *
+ * - aarch64: the virtual counter of the generic timer. Reading it from user
+ *   space traps unless the kernel allows it, so this needs
+ *   KernelArmExportVCNTUser, which CMakeLists.txt enables.
+ * - RISC-V: the time CSR. The frequency can't be read, it is taken from
+ *   TIMEBASE_RISCV_FREQ_HZ, which CMakeLists.txt sets for each platform.
+ *
+ * Otherwise, TIMEBASE_AVAILABLE is not defined.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__aarch64__)
+#include <sel4/config.h>
+#endif
+
+#if defined(__aarch64__) && defined(CONFIG_EXPORT_VCNT_USER)
+
+#define TIMEBASE_AVAILABLE
+
+//------------------------------------------------------------------------------
+static inline uint64_t
+timebase_getTicks(void)
+{
+    uint64_t ticks;
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r" (ticks) :: "memory");
+    return ticks;
+}
+
+//------------------------------------------------------------------------------
+static inline uint64_t
+timebase_getFreq(void)
+{
+    uint64_t freq;
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r" (freq));
+    return freq;
+}
+
+#elif defined(__riscv) && (__riscv_xlen == 64) \
+      && defined(TIMEBASE_RISCV_FREQ_HZ)
+
+#define TIMEBASE_AVAILABLE
+
+//------------------------------------------------------------------------------
+static inline uint64_t
+timebase_getTicks(void)
+{
+    uint64_t ticks;
+    __asm__ volatile("rdtime %0" : "=r" (ticks));
+    return ticks;
+}
+
+//------------------------------------------------------------------------------
+static inline uint64_t
+timebase_getFreq(void)
+{
+    return TIMEBASE_RISCV_FREQ_HZ;
+}
+
+#endif
+
+
+#if defined(TIMEBASE_AVAILABLE)
+
+//------------------------------------------------------------------------------
+// Convert ticks to microseconds without overflowing for large tick counts.
+static inline uint64_t
+timebase_ticksToUs(
+    uint64_t ticks)
+{
+    const uint64_t freq = timebase_getFreq();
+
+    return ((ticks / freq) * 1000000) + (((ticks % freq) * 1000000) / freq);
+}
+
+#endif // TIMEBASE_AVAILABLE
@@ -0,0 +1,50 @@
+/*
+ * Control header for the UART input dataport
+ *
+ * Copyright (C) 2024, HENSOLDT Cyber GmbH
+ * 
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * For commercial licensing, contact: info.cyber@hensoldt.net
+ *
+ * A driver supporting this puts the header at the start of the input dataport
+ * and the FIFO at UART_RX_CTRL_SIZE behind it. The driver owns the counters and
+ * the timestamp, the client owns the wake settings. The counters only increase,
+ * so the client detects overflows by comparing them with the values it has
+ * seen before and does not need to acknowledge anything.
+ *
+ * The legacy layout has the FIFO at the start of the dataport and an overflow
+ * flag byte at the very end, the driver stops adding data while it is set. Its
+ * first word is the FIFO capacity, which never matches UART_RX_CTRL_MAGIC.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define UART_RX_CTRL_MAGIC      0x43585255U // "URXC" in little endian
+#define UART_RX_CTRL_VERSION    1
+
+// Offset of the FIFO, keeps the header in a cache line of its own.
+#define UART_RX_CTRL_SIZE       64
+
+//------------------------------------------------------------------------------
+typedef struct
+{
+    uint32_t  magic;
+    uint32_t  version;
+
+    // written by the driver
+    uint32_t  overflow_cnt;     // overflows so far
+    uint32_t  dropped_bytes;    // bytes dropped because the FIFO was full
+    uint64_t  rx_timestamp;     // counter ticks when data was last added
+
+    // written by the client, a driver signals the data event only when at
+    // least wake_threshold bytes are in the FIFO, or when the oldest byte has
+    // waited for wake_latency_us. With both set to 0 it signals every update.
+    uint32_t  wake_threshold;   // bytes
+    uint32_t  wake_latency_us;
+} uart_rx_ctrl_t;
+
+_Static_assert(sizeof(uart_rx_ctrl_t) <= UART_RX_CTRL_SIZE,
+               "uart_rx_ctrl_t too large");
@@ -8,35 +8,245 @@
  * For commercial licensing, contact: info.cyber@hensoldt.net
  */
 
+#include "system_config.h"
+
 #include "OS_Error.h"
 #include "OS_Dataport.h"
 #include "lib_io/FifoDataport.h"
 #include "ringbuffer.h"
+#include "histogram.h"
+#include "ramp.h"
+#include "prbs.h"
+#include "crc.h"
+#include "timebase.h"
+#include "uart_rx_ctrl.h"
 #include "lib_debug/Debug.h"
 
 #include <camkes.h>
 
+#include <inttypes.h>
 #include <string.h>
 
 //#define FIFO_PROFILING
 
+// Process the data in the dataport FIFO in place instead of copying it into the
+// internal FIFO first. The internal FIFO is only used to quickly free space in
+// the dataport FIFO when processing falls behind and the fill level exceeds
+// RX_SPILL_THRESHOLD percent.
+//#define RX_ZERO_COPY
+#define RX_SPILL_THRESHOLD      50
+// Data processed in place is limited to chunks of this size, so the fill level
+// of the dataport FIFO is checked regularly.
+#define RX_ZERO_COPY_CHUNK_SIZE 512
+
+// Before blocking on the data event, poll the dataport FIFO for a while. The
+// number of polls adapts to how long recent bursts took to arrive, but stays
+// within these limits. This only pays off if the driver runs on another core.
+// On a single core, the tester has a higher priority than the driver, so the
+// driver can't add data while the tester polls. With both at 0, the tester
+// always blocks right away. On a dedicated core, 16 and 4096 are a start. A
+// minimum of 0 with a non-zero maximum is not valid, as a limit of 0 can't
+// measure anything. The limit starts in the middle of the range. While it is at
+// the minimum, every RX_SPIN_PROBE_INTERVAL blocks it probes with the maximum,
+// in case the data timing has changed.
+#define RX_SPIN_MIN             0
+#define RX_SPIN_MAX             0
+#define RX_SPIN_PROBE_INTERVAL  64
+
+#if (RX_SPIN_MAX > 0) && ((RX_SPIN_MIN == 0) || (RX_SPIN_MIN > RX_SPIN_MAX))
+#error "RX_SPIN_MIN must be between 1 and RX_SPIN_MAX"
+#endif
+
+// Ask the driver to signal new data only when this many bytes are available,
+// or when the oldest byte has waited for this long. This is published in the
+// control header of the input dataport, see uart_rx_ctrl.h, so it needs a driver
+// using the header. Set both to 0 to be woken up on every update.
+#define RX_WAKE_THRESHOLD       256
+#define RX_WAKE_LATENCY_US      1000
+
+// The test data is an incrementing byte sequence by default. Defining this as 7,
+// 15, 23 or 31 expects the PRBS of this order instead. Bit errors are counted
+// and reported then, but they don't stop the test.
+//#define TEST_PATTERN_PRBS       31
+
+// In framed mode, the data is a sequence of blocks with TEST_FRAME_SIZE bytes
+// of arbitrary payload, each followed by its CRC in little endian byte order.
+// Defining this as 32 or 16 selects CRC-32 or CRC-16, see crc.h. Bad frames are
+// counted and reported, but they don't stop the test. After a bad frame, the
+// alignment is searched again by sliding a frame-sized window forward byte by
+// byte until its CRC matches. Lost bytes usually cost the next frame, too, as
+// its start is consumed with the bad frame and not kept for the search. With
+// CRC-16, about 1.5% of the searches match on random data, such a false
+// match just leads to another bad frame and search.
+//#define TEST_FRAMED_CRC         32
+#define TEST_FRAME_SIZE         1024
+
+// Instead of the RX test, send the test pattern through the output dataport and
+// measure the TX path of the driver. Each round sends TX_BENCHMARK_BYTES in
+// writes of up to TX_BATCH_SIZE bytes, limited by the dataport size.
+//#define TX_BENCHMARK
+#define TX_BENCHMARK_ROUNDS     10
+#define TX_BENCHMARK_BYTES      (1024 * 1024)
+#define TX_BATCH_SIZE           4096
+
+#if defined(TX_BENCHMARK) && defined(UART_TEST_LOOPBACK)
+#error "TX_BENCHMARK and UART_TEST_LOOPBACK can't be used together"
+#endif
+
+// Continue after a dataport FIFO overflow instead of failing. Each overflow
+// leaves a gap in the data, and the incrementing sequence resyncs at the next
+// mismatch as long as gaps are pending. Mismatches without a pending gap are
+// still fatal.
+// - With the control header, see uart_rx_ctrl.h, the overflows are taken from
+//   the driver's counters as soon as they are detected, there is nothing to
+//   acknowledge. Each counted overflow is one gap, more may be detected while
+//   earlier gaps are still buffered. The lost bytes are the dropped bytes the
+//   driver reports.
+// - In the legacy layout, the overflow flag is acknowledged once the FIFO is
+//   drained, which leaves one gap. The lost bytes are estimated from the jump
+//   in the sequence, which is only known modulo 256.
+// Gaps still pending RX_RESYNC_WINDOW bytes after the data received when the
+// last overflow was handled were multiples of 256 bytes, they end without a
+// jump.
+//#define RX_OVERFLOW_TOLERANT
+#define RX_RESYNC_WINDOW        256
+
+// Synthetic processing load, the test context is set up with these values. The
+// unit is one dummy operation, which takes a few cycles. Besides a cost per
+// byte and per span, there can be a stall every LOAD_STALL_INTERVAL bytes and
+// memory accesses that walk through a buffer of LOAD_MEMORY_SIZE bytes in cache
+// line steps. The buffer only exists if LOAD_MEMORY_PER_SPAN is not 0.
+#define LOAD_OPS_PER_BYTE       1
+#define LOAD_OPS_PER_SPAN       0
+#define LOAD_STALL_INTERVAL     0
+#define LOAD_STALL_OPS          0
+#define LOAD_MEMORY_PER_SPAN    0
+#define LOAD_MEMORY_SIZE        (64 * 1024)
+
+// Search the smallest dataport FIFO and internal FIFO sizes that work without
+// overflows for the current baud rate and load, then end the test. Both sizes
+// are limited virtually, starting with the full dataport FIFO and the smallest
+// internal FIFO. Each step runs for CAPACITY_SEARCH_BYTES. A step fails if the
+// dataport FIFO fill level exceeds the limit, or on a real overflow, which is
+// only survived with RX_OVERFLOW_TOLERANT. On failure the internal FIFO limit
+// is doubled, on success the dataport limit is halved.
+//#define CAPACITY_SEARCH
+#define CAPACITY_SEARCH_BYTES   (256 * 1024)
+#define CAPACITY_SEARCH_MIN     256
+
+// Number of bytes up to and including a bad byte that are dumped on errors.
+#define ERROR_WINDOW_SIZE       64
+
+// Seems we need this internal FIFO on QEMU, as UART baudtrates are not
+// guaranteed there. And besides throttling, data sometimes still comes faster
+// than we can process it. The FIFO is mirrored, so all data can be processed
+// in one contiguous block.
+RINGBUFFER_DECLARE_MIRRORED(rx_fifo, 4096)
+
+#ifdef TEST_FRAMED_CRC
+#if (TEST_FRAMED_CRC == 32)
+#define FRAME_CRC_SIZE          4
+#define FRAME_CRC_INIT          CRC32_INIT
+#define frame_crc_update        crc32_update
+#define frame_crc_final         crc32_final
+#elif (TEST_FRAMED_CRC == 16)
+#define FRAME_CRC_SIZE          2
+#define FRAME_CRC_INIT          CRC16_INIT
+#define frame_crc_update(crc, buf, len) crc16_update((uint16_t)(crc), buf, len)
+#define frame_crc_final(crc)    crc16_final((uint16_t)(crc))
+#else
+#error "TEST_FRAMED_CRC must be 32 or 16"
+#endif
+#define FRAME_TOTAL_SIZE        (TEST_FRAME_SIZE + FRAME_CRC_SIZE)
+#endif // TEST_FRAMED_CRC
+
+// Synthetic processing load, see LOAD_OPS_PER_BYTE.
 typedef struct {
+    unsigned int   ops_per_byte;
+    unsigned int   ops_per_span;
+    size_t         stall_interval; // bytes, 0 for no stalls
+    unsigned int   stall_ops;
+    size_t         memory_per_span; // bytes accessed per span
+} load_model_t;
+
+// The fields are grouped by the side using them, so the reader draining the
+// dataport and the processing can run on different cores without false sharing
+// if RINGBUFFER_CACHE_LINE_SIZE is set.
+typedef struct {
+    // reader side, used by blocking_read()
     FifoDataport*  uart_fifo; // FIFO in dataport shared with the UART driver
-    ringbuffer_t   rb; // internal FIFO
-    size_t         bytes_processed;
-    uint8_t        byte_processor;
-    uint8_t        expecting_byte;
-    uint8_t        data_window[6];
-    // seems we need this internal FIFO on QEMU, as UART baudtrates are not
-    // guaranteed there. And besides throttling, data sometimes still comes
-    // faster than we can process it.
-    uint8_t        fifo_buffer[4096];
+    volatile uart_rx_ctrl_t* rx_ctrl; // control header, NULL in legacy layout
+    uint32_t       overflow_cnt_seen; // from the control header
+    uint32_t       dropped_bytes_seen; // from the control header
+    unsigned int   spin_limit; // current number of polls before blocking
+    unsigned int   spin_probe_cnt; // blocks at the minimum since the last probe
+    size_t         spins; // polls done
+    size_t         spin_hits; // polls that found new data
+    size_t         blocks; // waits for the data event
+    size_t         spurious_wakeups; // events without new data
+    size_t         fifo_peak; // highest dataport FIFO fill level seen
+    size_t         overflows; // acknowledged dataport FIFO overflows
+    size_t         bytes_dropped; // reported by the driver
+    size_t         rx_fifo_limit; // internal FIFO fill level limit
+    size_t         rx_fifo_peak; // highest internal FIFO fill level seen
 #ifdef FIFO_PROFILING
-    size_t         fifo_read_cnt;
-    size_t         fifo_reads[128];
+    histogram_t    fifo_reads; // bytes available per dataport read
+    size_t         wakeup_cnt; // wakeups in the current report interval
+    histogram_t    wakeups; // wakeups per report interval
 #endif // FIFO_PROFILING
+
+    // processing side, used by process_data()
+    size_t         bytes_processed RINGBUFFER_CACHE_ALIGNED;
+    uint8_t        byte_processor;
+    load_model_t   load;
+    size_t         load_stall_bytes; // bytes since the last stall
+#if (LOAD_MEMORY_PER_SPAN > 0)
+    size_t         load_memory_pos;
+#endif // LOAD_MEMORY_PER_SPAN > 0
+    uint8_t        expecting_byte;
+#ifdef TEST_PATTERN_PRBS
+    prbs_t         prbs;
+    size_t         prbs_errors_reported;
+#endif // TEST_PATTERN_PRBS
+#ifdef TEST_FRAMED_CRC
+    size_t         frame_pos; // bytes of the current frame received
+    uint32_t       frame_crc; // CRC over the payload received so far
+    uint32_t       frame_crc_rx; // CRC bytes received so far
+    size_t         frames_ok;
+    size_t         frames_bad;
+    bool           is_frame_search; // searching the alignment after an error
+    uint8_t        frame_buf[FRAME_TOTAL_SIZE]; // search window
+    size_t         frame_buf_len;
+    size_t         frame_resyncs;
+    size_t         frame_bytes_skipped; // while searching the alignment
+    size_t         frame_search_start; // bytes skipped when the search started
+#endif // TEST_FRAMED_CRC
+    uint8_t        history[ERROR_WINDOW_SIZE]; // byte n is at n % size
+#ifdef RX_OVERFLOW_TOLERANT
+    size_t         resync_gaps; // gaps from overflows not resynced yet
+    size_t         resync_end; // stream offset where pending gaps end
+    size_t         resyncs;
+    size_t         bytes_lost; // estimated
+#endif // RX_OVERFLOW_TOLERANT
+#ifdef TIMEBASE_AVAILABLE
+    uint64_t       time_start; // ticks when the first data was processed
+    uint64_t       time_report; // ticks at the last progress report
+    size_t         bytes_report; // bytes processed at the last report
+    uint64_t       rate_min; // lowest bytes/s of all report intervals
+    uint64_t       rate_max; // highest bytes/s of all report intervals
+#ifdef UART_TEST_LOOPBACK
+    size_t         tx_bytes_report; // bytes sent at the last report
+#endif // UART_TEST_LOOPBACK
+#endif // TIMEBASE_AVAILABLE
+
+    rx_fifo_t      rx_fifo; // internal FIFO, shared by reader and processing
 } test_ctx_t;
 
+#ifdef UART_TEST_LOOPBACK
+// Bytes sent by the TX thread of the loopback test.
+static size_t loopback_tx_bytes = 0;
+#endif // UART_TEST_LOOPBACK
+
 
 //---------------------------------------------------------------------------
 static void
@@ -56,63 +266,514 @@ data_processor(
 
 
 //---------------------------------------------------------------------------
-static OS_Error_t
-do_process(
+// Keep the last bytes of a span that starts at the given stream offset, so the
+// error window can cover bytes of previous spans.
+static void
+update_history(
     test_ctx_t* ctx,
-    const uint8_t data_byte)
+    size_t offset,
+    const uint8_t* buf,
+    size_t len)
 {
-    memmove(
-        ctx->data_window,
-        &(ctx->data_window[1]),
-        sizeof(ctx->data_window)-1 );
+    const size_t cnt = MIN(len, ERROR_WINDOW_SIZE);
+    const size_t pos = (offset + len - cnt) % ERROR_WINDOW_SIZE;
+    const size_t cnt_1st = MIN(cnt, ERROR_WINDOW_SIZE - pos);
+
+    memcpy(&(ctx->history[pos]), &buf[len - cnt], cnt_1st);
+    memcpy(ctx->history, &buf[len - cnt + cnt_1st], cnt - cnt_1st);
+}
 
-    ctx->data_window[sizeof(ctx->data_window)-1] = data_byte;
 
-    bool err = (data_byte != ctx->expecting_byte);
-    if (err)
+//---------------------------------------------------------------------------
+// Build the window of bytes up to and including the byte at the given index in
+// the span, which starts at stream offset span_start. Bytes before the span are
+// taken from the history. Returns the number of bytes in the window.
+static size_t
+get_error_window(
+    test_ctx_t* ctx,
+    size_t span_start,
+    const uint8_t* buf,
+    size_t idx,
+    uint8_t* window)
+{
+    const size_t end = span_start + idx + 1;
+    const size_t start = (end > ERROR_WINDOW_SIZE) ? end - ERROR_WINDOW_SIZE : 0;
+
+    for (size_t offset = start; offset < end; offset++)
     {
-        Debug_LOG_ERROR(
-            "bytes processed: 0x%zx (%zu), expected 0x%02x, read 0x%02x, window:",
-            ctx->bytes_processed,
-            ctx->bytes_processed,
-            ctx->expecting_byte,
-            data_byte);
-        Debug_DUMP_ERROR(ctx->data_window, sizeof(ctx->data_window));
+        window[offset - start] = (offset >= span_start)
+                                 ? buf[offset - span_start]
+                                 : ctx->history[offset % ERROR_WINDOW_SIZE];
+    }
 
-        // Re-sync with the data stream, in case caller wants to continue.
-        ctx->expecting_byte = data_byte + 1;
+    return end - start;
+}
+
+
+//---------------------------------------------------------------------------
+static void
+report_progress(
+    test_ctx_t* ctx)
+{
+    Debug_LOG_INFO("bytes processed: 0x%zx", ctx->bytes_processed);
+
+#ifdef TIMEBASE_AVAILABLE
+    const uint64_t now = timebase_getTicks();
+    const uint64_t us_interval = timebase_ticksToUs(now - ctx->time_report);
+    const uint64_t us_total = timebase_ticksToUs(now - ctx->time_start);
+    if ((us_interval > 0) && (us_total > 0))
+    {
+        const uint64_t rate =
+            (uint64_t)(ctx->bytes_processed - ctx->bytes_report) * 1000000
+            / us_interval;
+        const uint64_t rate_avg =
+            (uint64_t)ctx->bytes_processed * 1000000 / us_total;
+
+        if ((0 == ctx->rate_min) || (rate < ctx->rate_min))
+        {
+            ctx->rate_min = rate;
+        }
+        if (rate > ctx->rate_max)
+        {
+            ctx->rate_max = rate;
+        }
+
+        // With 8N1 framing, a byte takes 10 bits on the line.
+        Debug_LOG_INFO(
+            "throughput: %" PRIu64 " B/s (%" PRIu64 "%% of %d baud), "
+            "avg %" PRIu64 " B/s, min %" PRIu64 " B/s, max %" PRIu64 " B/s",
+            rate, rate * 10 * 100 / UART_TEST_BAUD_RATE, UART_TEST_BAUD_RATE,
+            rate_avg, ctx->rate_min, ctx->rate_max);
     }
-    else
+    ctx->time_report = now;
+    ctx->bytes_report = ctx->bytes_processed;
+#endif // TIMEBASE_AVAILABLE
+
+#ifdef UART_TEST_LOOPBACK
+    const size_t tx_bytes = __atomic_load_n(&loopback_tx_bytes,
+                                            __ATOMIC_RELAXED);
+    Debug_LOG_INFO("TX: bytes sent 0x%zx", tx_bytes);
+#ifdef TIMEBASE_AVAILABLE
+    if (us_interval > 0)
     {
-        ctx->expecting_byte++;
+        Debug_LOG_INFO(
+            "TX throughput: %" PRIu64 " B/s",
+            (uint64_t)(tx_bytes - ctx->tx_bytes_report) * 1000000
+            / us_interval);
     }
+    ctx->tx_bytes_report = tx_bytes;
+#endif // TIMEBASE_AVAILABLE
+#endif // UART_TEST_LOOPBACK
 
+    const size_t fifo_capacity = FifoDataport_getCapacity(ctx->uart_fifo);
+    Debug_LOG_INFO(
+        "dataport FIFO: peak %zu of %zu, margin %zu",
+        ctx->fifo_peak, fifo_capacity, fifo_capacity - ctx->fifo_peak);
 
-    // Call a dummy processing function that creates some load.
-    data_processor(ctx, data_byte);
+#ifdef RX_OVERFLOW_TOLERANT
+    Debug_LOG_INFO(
+        "loss: overflows %zu, resyncs %zu, bytes lost %zu, dropped by driver "
+        "%zu", ctx->overflows, ctx->resyncs, ctx->bytes_lost,
+        ctx->bytes_dropped);
+#endif // RX_OVERFLOW_TOLERANT
 
-    ctx->bytes_processed++;
-    if (0 == (ctx->bytes_processed % (64 * 1024)))
+    ringbuffer_t* rb = &(ctx->rx_fifo.rb);
+    ringbuffer_stats_t stats;
+    if (ringbuffer_getStats(rb, &stats))
     {
-        Debug_LOG_INFO("bytes processed: 0x%zx", ctx->bytes_processed);
+        Debug_LOG_INFO(
+            "FIFO: peak %zu of %zu, in %zu, out %zu, wraps %zu, truncated %zu",
+            stats.peak_used, ringbuffer_getCapacity(rb), stats.bytes_in,
+            stats.bytes_out, stats.wraps, stats.writes_truncated);
+    }
+    Debug_LOG_INFO(
+        "wait: spins %zu, spin hits %zu, blocks %zu, spurious wakeups %zu, "
+        "spin limit %u",
+        ctx->spins, ctx->spin_hits, ctx->blocks, ctx->spurious_wakeups,
+        ctx->spin_limit);
+
+#ifdef TEST_PATTERN_PRBS
+    const prbs_t* prbs = &(ctx->prbs);
+    if (prbs->errors != ctx->prbs_errors_reported)
+    {
+        Debug_LOG_ERROR(
+            "PRBS-%u: %zu new bit errors",
+            prbs->order, prbs->errors - ctx->prbs_errors_reported);
+        ctx->prbs_errors_reported = prbs->errors;
+    }
+    Debug_LOG_INFO(
+        "PRBS-%u: bits checked %zu, bit errors %zu",
+        prbs->order, prbs->bits, prbs->errors);
+#endif // TEST_PATTERN_PRBS
+#ifdef TEST_FRAMED_CRC
+    Debug_LOG_INFO(
+        "CRC-%d frames: ok %zu, bad %zu, resyncs %zu, bytes skipped %zu",
+        TEST_FRAMED_CRC, ctx->frames_ok, ctx->frames_bad, ctx->frame_resyncs,
+        ctx->frame_bytes_skipped);
+#endif // TEST_FRAMED_CRC
 #ifdef FIFO_PROFILING
-        char buf[100] = { 0 };
-        size_t idx = 0;
-        while (idx < ctx->fifo_read_cnt)
+    char buf[256];
+    Debug_LOG_INFO(
+        "avail per read: %s",
+        histogram_format(&ctx->fifo_reads, buf, sizeof(buf)));
+    histogram_clear(&ctx->fifo_reads);
+
+    histogram_record(&ctx->wakeups, ctx->wakeup_cnt);
+    ctx->wakeup_cnt = 0;
+    Debug_LOG_INFO(
+        "wakeups per 64 KiB: %s",
+        histogram_format(&ctx->wakeups, buf, sizeof(buf)));
+#endif // FIFO_PROFILING
+}
+
+
+#ifdef TEST_FRAMED_CRC
+
+//---------------------------------------------------------------------------
+// Search the frame alignment in the data, returns the number of bytes consumed.
+// The search ends when the window holds a frame with a matching CRC, the data
+// after it is aligned then.
+static size_t
+search_frame(
+    test_ctx_t* ctx,
+    const uint8_t* buf,
+    size_t len)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        const size_t cnt = MIN(len - i, FRAME_TOTAL_SIZE - ctx->frame_buf_len);
+        memcpy(&(ctx->frame_buf[ctx->frame_buf_len]), &buf[i], cnt);
+        ctx->frame_buf_len += cnt;
+        i += cnt;
+        if (ctx->frame_buf_len < FRAME_TOTAL_SIZE)
         {
-            int l = sprintf(buf, "avail[%3zu]:", idx);
-            while (idx < ctx->fifo_read_cnt)
-            {
-                l += sprintf(&buf[l], " %4zd", ctx->fifo_reads[idx++]);
-                if (0 == (idx & 0x7)) { break; }
-            }
-            Debug_LOG_INFO("%s", buf);
+            break;
         }
-        ctx->fifo_read_cnt = 0;
-#endif // FIFO_PROFILING
+
+        uint32_t crc_rx = 0;
+        for (size_t n = 0; n < FRAME_CRC_SIZE; n++)
+        {
+            crc_rx |= (uint32_t)ctx->frame_buf[TEST_FRAME_SIZE + n] << (8 * n);
+        }
+        const uint32_t crc = frame_crc_final(
+                                frame_crc_update(FRAME_CRC_INIT,
+                                                 ctx->frame_buf,
+                                                 TEST_FRAME_SIZE));
+        if (crc == crc_rx)
+        {
+            Debug_LOG_WARNING(
+                "frame alignment found, %zu bytes skipped",
+                ctx->frame_bytes_skipped - ctx->frame_search_start);
+            ctx->frames_ok++;
+            ctx->frame_resyncs++;
+            ctx->is_frame_search = false;
+            ctx->frame_buf_len = 0;
+            break;
+        }
+
+        // Slide the window forward by one byte.
+        memmove(ctx->frame_buf, &(ctx->frame_buf[1]), FRAME_TOTAL_SIZE - 1);
+        ctx->frame_buf_len--;
+        ctx->frame_bytes_skipped++;
+    }
+
+    return i;
+}
+
+
+//---------------------------------------------------------------------------
+static void
+verify_frames(
+    test_ctx_t* ctx,
+    const uint8_t* buf,
+    size_t len)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        if (ctx->is_frame_search)
+        {
+            i += search_frame(ctx, &buf[i], len - i);
+            continue;
+        }
+
+        // Run the CRC over as much payload as possible at once.
+        if (ctx->frame_pos < TEST_FRAME_SIZE)
+        {
+            const size_t cnt = MIN(len - i, TEST_FRAME_SIZE - ctx->frame_pos);
+            ctx->frame_crc = frame_crc_update(ctx->frame_crc, &buf[i], cnt);
+            ctx->frame_pos += cnt;
+            i += cnt;
+            continue;
+        }
+
+        ctx->frame_crc_rx |= (uint32_t)buf[i]
+                             << (8 * (ctx->frame_pos - TEST_FRAME_SIZE));
+        ctx->frame_pos++;
+        i++;
+        if (ctx->frame_pos < TEST_FRAME_SIZE + FRAME_CRC_SIZE)
+        {
+            continue;
+        }
+
+        const uint32_t crc = frame_crc_final(ctx->frame_crc);
+        if (crc == ctx->frame_crc_rx)
+        {
+            ctx->frames_ok++;
+        }
+        else
+        {
+            Debug_LOG_ERROR(
+                "frame %zu: CRC expected 0x%x, received 0x%x",
+                ctx->frames_ok + ctx->frames_bad,
+                (unsigned int)crc, (unsigned int)ctx->frame_crc_rx);
+            ctx->frames_bad++;
+            ctx->is_frame_search = true;
+            ctx->frame_search_start = ctx->frame_bytes_skipped;
+        }
+
+        ctx->frame_pos = 0;
+        ctx->frame_crc = FRAME_CRC_INIT;
+        ctx->frame_crc_rx = 0;
+    }
+}
+
+#endif // TEST_FRAMED_CRC
+
+
+//---------------------------------------------------------------------------
+// Stage: check the data against the expected test pattern.
+static size_t
+verify_span(
+    test_ctx_t* ctx,
+    const uint8_t* buf,
+    size_t len)
+{
+#if defined(TEST_FRAMED_CRC)
+    // The payload is not checked, errors show up as bad frames.
+    verify_frames(ctx, buf, len);
+    return len;
+#elif defined(TEST_PATTERN_PRBS)
+    // The checker synchronizes itself, so all data is consumed and the errors
+    // are just counted.
+    prbs_verify(&(ctx->prbs), buf, len);
+    return len;
+#else
+    size_t cnt = ramp_findMismatch(buf, len, ctx->expecting_byte);
+#ifdef RX_OVERFLOW_TOLERANT
+    while ((cnt < len) && (ctx->resync_gaps > 0))
+    {
+        // Data was lost in an overflow, continue with the sequence as it is
+        // now. The driver's count is taken when the overflow is detected,
+        // without it the loss is only known modulo 256.
+        if (NULL == ctx->rx_ctrl)
+        {
+            const uint8_t expected = (uint8_t)(ctx->expecting_byte + cnt);
+            ctx->bytes_lost += (uint8_t)(buf[cnt] - expected);
+        }
+        ctx->resyncs++;
+        ctx->resync_gaps--;
+
+        ctx->expecting_byte = (uint8_t)(buf[cnt] - cnt);
+        cnt += ramp_findMismatch(&buf[cnt], len - cnt, buf[cnt]);
+    }
+    if ((ctx->resync_gaps > 0)
+        && (ctx->bytes_processed + cnt >= ctx->resync_end))
+    {
+        // The sequence did not jump for these gaps, so they were multiples of
+        // 256 bytes. Stop waiting for a jump, it would hide the next real
+        // error.
+        ctx->resyncs += ctx->resync_gaps;
+        ctx->resync_gaps = 0;
     }
+#endif // RX_OVERFLOW_TOLERANT
+    ctx->expecting_byte = (uint8_t)(ctx->expecting_byte + cnt);
+
+    return cnt;
+#endif // TEST_FRAMED_CRC, TEST_PATTERN_PRBS
+}
+
+
+//---------------------------------------------------------------------------
+static void
+burn_ops(
+    test_ctx_t* ctx,
+    unsigned int ops)
+{
+    for (unsigned int i = 0; i < ops; i++)
+    {
+        data_processor(ctx, (uint8_t)i);
+    }
+}
+
 
-    return err ? OS_ERROR_INVALID_STATE : OS_SUCCESS;
+#if (LOAD_MEMORY_PER_SPAN > 0)
+
+//---------------------------------------------------------------------------
+static void
+touch_memory(
+    test_ctx_t* ctx,
+    size_t len)
+{
+    static uint8_t load_memory[LOAD_MEMORY_SIZE];
+    const size_t line = 64;
+
+    for (size_t cnt = 0; cnt < len; cnt += line)
+    {
+        ((volatile uint8_t*)load_memory)[ctx->load_memory_pos]++;
+        ctx->load_memory_pos = (ctx->load_memory_pos + line)
+                               % sizeof(load_memory);
+    }
+}
+
+#endif // LOAD_MEMORY_PER_SPAN > 0
+
+
+//---------------------------------------------------------------------------
+// Stage: dummy processing that creates some load, see load_model_t.
+static size_t
+load_span(
+    test_ctx_t* ctx,
+    const uint8_t* buf,
+    size_t len)
+{
+    const load_model_t* load = &(ctx->load);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        for (unsigned int op = 0; op < load->ops_per_byte; op++)
+        {
+            data_processor(ctx, buf[i]);
+        }
+    }
+
+    burn_ops(ctx, load->ops_per_span);
+#if (LOAD_MEMORY_PER_SPAN > 0)
+    touch_memory(ctx, load->memory_per_span);
+#endif // LOAD_MEMORY_PER_SPAN > 0
+
+    if (load->stall_interval > 0)
+    {
+        ctx->load_stall_bytes += len;
+        while (ctx->load_stall_bytes >= load->stall_interval)
+        {
+            burn_ops(ctx, load->stall_ops);
+            ctx->load_stall_bytes -= load->stall_interval;
+        }
+    }
+
+    return len;
+}
+
+
+//---------------------------------------------------------------------------
+// Stage: update the counters and the history for the error window, report the
+// progress every 64 KiB.
+static size_t
+count_span(
+    test_ctx_t* ctx,
+    const uint8_t* buf,
+    size_t len)
+{
+    update_history(ctx, ctx->bytes_processed, buf, len);
+
+    const size_t report_interval = 64 * 1024;
+    const size_t prev = ctx->bytes_processed;
+#ifdef TIMEBASE_AVAILABLE
+    if (0 == prev)
+    {
+        ctx->time_start = timebase_getTicks();
+        ctx->time_report = ctx->time_start;
+    }
+#endif // TIMEBASE_AVAILABLE
+    ctx->bytes_processed += len;
+    if ((prev / report_interval) != (ctx->bytes_processed / report_interval))
+    {
+        report_progress(ctx);
+    }
+
+    return len;
+}
+
+
+//---------------------------------------------------------------------------
+// Run all processing stages on the span, returns the number of bytes that
+// passed all of them. Each stage takes a span and returns how many bytes of it
+// it has consumed, the following stages see only the consumed part.
+static size_t
+do_process_span(
+    test_ctx_t* ctx,
+    const uint8_t* buf,
+    size_t len)
+{
+    len = verify_span(ctx, buf, len);
+    len = load_span(ctx, buf, len);
+    len = count_span(ctx, buf, len);
+
+    return len;
+}
+
+
+//---------------------------------------------------------------------------
+static OS_Error_t
+process_buffer(
+    test_ctx_t*     ctx,
+    const uint8_t*  buffer,
+    size_t          len)
+{
+    rx_fifo_t* fifo = &(ctx->rx_fifo);
+
+    assert(buffer);
+
+    const size_t span_start = ctx->bytes_processed;
+    const size_t cnt_valid = do_process_span(ctx, buffer, len);
+
+    if (cnt_valid < len)
+    {
+        const size_t cnt_processed = cnt_valid;
+        const uint8_t data_byte = buffer[cnt_processed];
+        Debug_LOG_ERROR(
+            "bytes processed: 0x%zx (%zu), expected 0x%02x, read 0x%02x, window:",
+            ctx->bytes_processed,
+            ctx->bytes_processed,
+            ctx->expecting_byte,
+            data_byte);
+        uint8_t window[ERROR_WINDOW_SIZE];
+        const size_t window_len = get_error_window(
+                                    ctx, span_start, buffer, cnt_processed,
+                                    window);
+        Debug_DUMP_ERROR(window, window_len);
+
+        // Re-sync with the data stream, in case caller wants to continue.
+        ctx->expecting_byte = data_byte + 1;
+
+        Debug_LOG_ERROR(
+            "buffer %p, processed %zu (0x%zx) of %zu",
+            buffer, cnt_processed, cnt_processed, len);
+        Debug_DUMP_ERROR(
+            buffer,
+            MIN(cnt_processed+3, len));
+        ringbuffer_t* rb = &(fifo->rb);
+        Debug_LOG_ERROR(
+            "rb: used %zu (0x%zx) of %zu, head %zu (0x%zx), tail %zu (0x%zx)",
+            ringbuffer_getUsed(rb), ringbuffer_getUsed(rb),
+            rb->capacity, rb->head, rb->head, rb->tail, rb->tail);
+        Debug_DUMP_ERROR(rb->buffer, rb->capacity);
+        Debug_LOG_ERROR(
+            "FIFO: used %zu (0x%zx) of %zu, head %zu (0x%zx)",
+            FifoDataport_getSize(ctx->uart_fifo),
+            FifoDataport_getSize(ctx->uart_fifo),
+            FifoDataport_getCapacity(ctx->uart_fifo),
+            ctx->uart_fifo->dataStruct.first,
+            ctx->uart_fifo->dataStruct.first);
+        Debug_DUMP_ERROR(
+            ctx->uart_fifo->data,
+            FifoDataport_getCapacity(ctx->uart_fifo));
+        return OS_ERROR_GENERIC;
+    }
+
+    return OS_SUCCESS;
 }
 
 
@@ -121,60 +782,82 @@ static OS_Error_t
 process_data(
     test_ctx_t*  ctx)
 {
-    ringbuffer_t* rb = &(ctx->rb);
+    rx_fifo_t* fifo = &(ctx->rx_fifo);
+    OS_Error_t ret;
 
-    // Get a contiguous buffer from the internal FIFO that we can pass on
-    // for processing. Since the FIFO can wrap around, there is no guarantee
-    // that we can get all available data in one contiguous buffer.
-    for(;;)
+    // The internal FIFO is mirrored, so all available data is in one
+    // contiguous buffer that we can pass on for processing.
+    uint8_t* buffer = NULL;
+    size_t len = rx_fifo_getReadPtr(fifo, (void**)&buffer);
+    if (len > 0)
     {
-        uint8_t* buffer = NULL;
-        size_t len = ringbuffer_getReadPtr(rb, (void**)&buffer);
-        if (0 == len)
+        ret = process_buffer(ctx, buffer, len);
+        if (OS_SUCCESS != ret)
         {
-            return OS_SUCCESS;
+            return ret;
         }
 
-        assert(buffer); // We have data in the FIFO, so this can't be NULL.
-        for(size_t cnt_processed = 0; cnt_processed < len; cnt_processed++)
+        rx_fifo_flush(fifo, len);
+        return OS_SUCCESS;
+    }
+
+#ifdef RX_ZERO_COPY
+    // The internal FIFO is empty, so nothing older is pending and the data in
+    // the dataport FIFO can be processed in place.
+    len = FifoDataport_getContiguous(ctx->uart_fifo, (void**)&buffer);
+    len = MIN(len, RX_ZERO_COPY_CHUNK_SIZE);
+    if (len > 0)
+    {
+        ret = process_buffer(ctx, buffer, len);
+        if (OS_SUCCESS != ret)
         {
+            return ret;
+        }
 
-            uint8_t data_byte = buffer[cnt_processed];
-            // call a dummy function to simulate processing load
-            OS_Error_t ret = do_process(ctx, data_byte);
-            if (OS_SUCCESS != ret)
-            {
-                Debug_LOG_ERROR("do_process() failed, code %d", ret);
+        FifoDataport_remove(ctx->uart_fifo, len);
+#ifdef FIFO_PROFILING
+        histogram_record(&ctx->fifo_reads, len);
+#endif // FIFO_PROFILING
+    }
+#endif // RX_ZERO_COPY
 
-                Debug_LOG_ERROR(
-                    "buffer %p, processed %zu (0x%zx) of %zu",
-                    buffer, cnt_processed, cnt_processed, len);
-                Debug_DUMP_ERROR(
-                    buffer,
-                    MIN(cnt_processed+3, len));
-                Debug_LOG_ERROR(
-                    "rb: used %zu (0x%zx) of %zu, head %zu (0x%zx)",
-                    rb->used, rb->used, rb->capacity, rb->head, rb->head);
-                Debug_DUMP_ERROR(rb->buffer, rb->capacity);
-                Debug_LOG_ERROR(
-                    "FIFO: used %zu (0x%zx) of %zu, head %zu (0x%zx)",
-                    FifoDataport_getSize(ctx->uart_fifo),
-                    FifoDataport_getSize(ctx->uart_fifo),
-                    FifoDataport_getCapacity(ctx->uart_fifo),
-                    ctx->uart_fifo->dataStruct.first,
-                    ctx->uart_fifo->dataStruct.first);
-                Debug_DUMP_ERROR(
-                    ctx->uart_fifo->data,
-                    FifoDataport_getCapacity(ctx->uart_fifo));
-                return OS_ERROR_GENERIC;
-            }
-        }
+    return OS_SUCCESS;
+}
+
+
+//---------------------------------------------------------------------------
+// Use the control header if the driver provides one, fall back to the legacy
+// layout otherwise. Call this only after the first data event, the header may
+// not be written before.
+static void
+setup_dataport(
+    test_ctx_t*  ctx,
+    void*        buf_port)
+{
+    volatile uart_rx_ctrl_t* ctrl = (volatile uart_rx_ctrl_t*)buf_port;
 
-        ringbuffer_flush(rb, len);
+    if ((UART_RX_CTRL_MAGIC != ctrl->magic)
+        || (UART_RX_CTRL_VERSION != ctrl->version))
+    {
+        Debug_LOG_INFO("legacy dataport layout, no wake control");
+        ctx->rx_ctrl = NULL;
+        ctx->uart_fifo = (FifoDataport*)buf_port;
+        return;
+    }
 
-    } // for(;;)
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    ctx->rx_ctrl = ctrl;
+    ctx->uart_fifo = (FifoDataport*)((uintptr_t)buf_port + UART_RX_CTRL_SIZE);
+    ctx->overflow_cnt_seen = ctrl->overflow_cnt;
+    ctx->dropped_bytes_seen = ctrl->dropped_bytes;
 
-    UNREACHABLE();
+    ctrl->wake_threshold  = RX_WAKE_THRESHOLD;
+    ctrl->wake_latency_us = RX_WAKE_LATENCY_US;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    Debug_LOG_INFO(
+        "dataport control header v%u, wake threshold %d bytes, latency %d us",
+        (unsigned int)ctrl->version, RX_WAKE_THRESHOLD, RX_WAKE_LATENCY_US);
 }
 
 
@@ -183,7 +866,13 @@ static bool
 is_fifo_overflow(
     test_ctx_t*  ctx)
 {
-    // Currently, the overflow "flag" is defined as byte and not as bit.
+    if (NULL != ctx->rx_ctrl)
+    {
+        return (ctx->rx_ctrl->overflow_cnt != ctx->overflow_cnt_seen);
+    }
+
+    // In the legacy layout, the overflow "flag" is defined as byte and not as
+    // bit.
     uint8_t isFifoOverflow = *((volatile uint8_t*)(
                                     (uintptr_t)ctx->uart_fifo
                                     + (Uart_INPUT_FIFO_DATAPORT_SIZE - 1) ));
@@ -192,13 +881,137 @@ is_fifo_overflow(
 }
 
 
+//---------------------------------------------------------------------------
+// Take over the counters from the control header, returns the number of new
+// overflows. The driver keeps adding data after an overflow, so there is
+// nothing to acknowledge.
+static size_t
+update_fifo_overflow(
+    test_ctx_t*  ctx)
+{
+    volatile uart_rx_ctrl_t* ctrl = ctx->rx_ctrl;
+
+    // The counters wrap around, the difference is still correct.
+    const uint32_t overflow_cnt = ctrl->overflow_cnt;
+    const uint32_t dropped_bytes = ctrl->dropped_bytes;
+    const size_t overflows = (uint32_t)(overflow_cnt - ctx->overflow_cnt_seen);
+    const size_t dropped = (uint32_t)(dropped_bytes - ctx->dropped_bytes_seen);
+    ctx->overflows += overflows;
+    ctx->bytes_dropped += dropped;
+    ctx->overflow_cnt_seen = overflow_cnt;
+    ctx->dropped_bytes_seen = dropped_bytes;
+
+#ifdef RX_OVERFLOW_TOLERANT
+    ctx->bytes_lost += dropped;
+#endif // RX_OVERFLOW_TOLERANT
+
+    return overflows;
+}
+
+
+#ifdef RX_OVERFLOW_TOLERANT
+
+//---------------------------------------------------------------------------
+// Expect the given number of gaps in the data received so far, or in the next
+// RX_RESYNC_WINDOW bytes.
+static void
+start_resync(
+    test_ctx_t*  ctx,
+    size_t       gaps)
+{
+    ctx->resync_gaps += gaps;
+    ctx->resync_end = ctx->bytes_processed
+                      + rx_fifo_getUsed(&(ctx->rx_fifo))
+                      + FifoDataport_getSize(ctx->uart_fifo)
+                      + RX_RESYNC_WINDOW;
+}
+
+
+//---------------------------------------------------------------------------
+// Clear the overflow flag of the legacy layout, the driver adds new data again
+// then.
+static void
+ack_fifo_overflow(
+    test_ctx_t*  ctx)
+{
+    *((volatile uint8_t*)((uintptr_t)ctx->uart_fifo
+                          + (Uart_INPUT_FIFO_DATAPORT_SIZE - 1) )) = 0;
+    ctx->overflows++;
+}
+
+#endif // RX_OVERFLOW_TOLERANT
+
+
+#if (RX_SPIN_MAX > 0)
+
+//---------------------------------------------------------------------------
+// Tell the CPU that this is a polling loop. On Arm this is the yield hint, it
+// may save power or help another hardware thread, but it does not give the
+// core to another thread.
+static inline void
+cpu_relax(void)
+{
+#if defined(__aarch64__) || (defined(__arm__) && (__ARM_ARCH >= 7))
+    __asm__ volatile("yield" ::: "memory");
+#else
+    __asm__ volatile("" ::: "memory");
+#endif
+}
+
+
+//---------------------------------------------------------------------------
+// Poll the dataport FIFO up to the current limit, returns true if data has
+// arrived. A hit sets the limit to twice the polls it took, so a late hit
+// doubles it. A miss halves it, as waiting longer is not likely to pay off then.
+static bool
+spin_wait(
+    test_ctx_t*  ctx)
+{
+    unsigned int limit = ctx->spin_limit;
+    if (limit <= RX_SPIN_MIN)
+    {
+        // Misses can't lower the limit any further, so the timing is probed
+        // with the maximum now and then.
+        ctx->spin_probe_cnt++;
+        if (ctx->spin_probe_cnt >= RX_SPIN_PROBE_INTERVAL)
+        {
+            ctx->spin_probe_cnt = 0;
+            limit = RX_SPIN_MAX;
+        }
+    }
+    unsigned int new_limit = limit / 2;
+    bool is_hit = false;
+
+    unsigned int polls = 0;
+    while (polls < limit)
+    {
+        cpu_relax();
+        polls++;
+        if (FifoDataport_getSize(ctx->uart_fifo) > 0)
+        {
+            new_limit = 2 * polls;
+            is_hit = true;
+            ctx->spin_hits++;
+            break;
+        }
+    }
+
+    ctx->spins += polls;
+    ctx->spin_limit = MIN(MAX(new_limit, RX_SPIN_MIN), RX_SPIN_MAX);
+
+    return is_hit;
+}
+
+#endif // RX_SPIN_MAX > 0
+
+
 //---------------------------------------------------------------------------
 static OS_Error_t
 blocking_read(
     test_ctx_t*  ctx)
 {
     FifoDataport* fifo = ctx->uart_fifo;
-    ringbuffer_t* rb = &(ctx->rb);
+    rx_fifo_t* rx_fifo = &(ctx->rx_fifo);
     bool is_overflow = false;
 
     for (;;)
@@ -207,9 +1020,28 @@ blocking_read(
         // set an internal flag that we check later
         if (!is_overflow && is_fifo_overflow(ctx))
         {
-            is_overflow = true;
             Debug_LOG_ERROR("dataport FIFO overflow detected, %zu left to be read",
                             FifoDataport_getSize(fifo));
+            if (NULL != ctx->rx_ctrl)
+            {
+                Debug_LOG_ERROR(
+                    "driver: overflows %u, bytes dropped %u, last RX at %"
+                    PRIu64, (unsigned int)ctx->rx_ctrl->overflow_cnt,
+                    (unsigned int)ctx->rx_ctrl->dropped_bytes,
+                    (uint64_t)ctx->rx_ctrl->rx_timestamp);
+
+                // The overflow is handled right away, as the driver does not
+                // stop adding data and the FIFO may never be drained.
+#ifdef RX_OVERFLOW_TOLERANT
+                start_resync(ctx, update_fifo_overflow(ctx));
+                continue;
+#else
+                update_fifo_overflow(ctx);
+                return OS_ERROR_OVERFLOW_DETECTED;
+#endif // RX_OVERFLOW_TOLERANT
+            }
+
+            is_overflow = true;
         }
 
         // Try to read new data to drain the dataport FIFO.
@@ -217,41 +1049,88 @@ blocking_read(
         size_t avail = FifoDataport_getContiguous(fifo, &buffer);
         if (avail > 0)
         {
-            // put the new data in our internal buffer
+            ctx->fifo_peak = MAX(ctx->fifo_peak, FifoDataport_getSize(fifo));
+
+#ifdef RX_ZERO_COPY
+            // Leave the data in the dataport FIFO for processing in place, as
+            // long as the driver has enough space left.
+            if (FifoDataport_getSize(fifo) * 100
+                < FifoDataport_getCapacity(fifo) * RX_SPILL_THRESHOLD)
+            {
+                return OS_SUCCESS;
+            }
+#endif // RX_ZERO_COPY
+
+            // put the new data in our internal buffer, as far as the limit
+            // allows. Without a limit, the write is not capped, so the ring
+            // buffer counts truncated writes.
             assert(buffer);
-            size_t copied = ringbuffer_write(rb, buffer, avail);
+            const size_t capacity = ringbuffer_getCapacity(&(rx_fifo->rb));
+            const size_t used = rx_fifo_getUsed(rx_fifo);
+            const size_t room = (used < ctx->rx_fifo_limit)
+                                ? ctx->rx_fifo_limit - used
+                                : 0;
+            const size_t len = (ctx->rx_fifo_limit < capacity)
+                               ? MIN(avail, room)
+                               : avail;
+            size_t copied = rx_fifo_write(rx_fifo, buffer, len);
             assert(copied <= avail);
             if (0 == copied)
             {
-                Debug_LOG_ERROR("ringbuffer full, avail %zu", avail);
+                if (ctx->rx_fifo_limit == capacity)
+                {
+                    Debug_LOG_ERROR("ringbuffer full, avail %zu", avail);
+                }
                 return OS_SUCCESS;
             }
+            ctx->rx_fifo_peak = MAX(ctx->rx_fifo_peak, used + copied);
 
             FifoDataport_remove(fifo, copied);
 #ifdef FIFO_PROFILING
-            ctx->fifo_reads[ctx->fifo_read_cnt++] = avail;
+            histogram_record(&ctx->fifo_reads, avail);
 #endif // FIFO_PROFILING
             return OS_SUCCESS;
         }
 
-        // There was no new data in the FIFO. Check if there was an overflow,
-        // in this case the driver still not add new data to the buffer until
-        // the overflow is resolved.
+        // There was no new data in the FIFO. Check if there was an overflow
+        // in the legacy layout, in this case the driver still not add new
+        // data to the buffer until the overflow is resolved.
         if (is_overflow)
         {
+#ifdef RX_OVERFLOW_TOLERANT
+            // All data from before the overflow has been read, acknowledge it
+            // so the driver adds new data again. The data lost in the overflow
+            // is missing right before the data the driver adds now.
+            ack_fifo_overflow(ctx);
+            start_resync(ctx, 1);
+            is_overflow = false;
+            Debug_LOG_WARNING("dataport FIFO overflow %zu acknowledged",
+                              ctx->overflows);
+            continue;
+#else
             // In a real application we should handle the overflow, but for the
             // test here it is considered fatal, as we expect things to be good
             // enough to never run into overflows.
             return OS_ERROR_OVERFLOW_DETECTED;
+#endif // RX_OVERFLOW_TOLERANT
         }
 
         // There was no new data in the FIFO. However, we can't block if there
         // is still data in the internal FIFO buffer.
-        if (!ringbuffer_isEmpty(rb))
+        if (!rx_fifo_isEmpty(rx_fifo))
         {
             return OS_SUCCESS;
         }
 
+#if (RX_SPIN_MAX > 0)
+        // Data might arrive very soon, polling for it is cheaper than blocking
+        // then.
+        if (spin_wait(ctx))
+        {
+            continue;
+        }
+#endif // RX_SPIN_MAX > 0
+
         // Block waiting for an event that reports there is new data in the
         // dataport FIFO. We can never end in a deadlock here, even if the
         // driver update the dataport FIFO in parallel. The worst thing that
@@ -259,6 +1138,14 @@ blocking_read(
         // we have processed this data above already.
 
         uart_event_wait();
+        ctx->blocks++;
+        if (0 == FifoDataport_getSize(fifo))
+        {
+            ctx->spurious_wakeups++;
+        }
+#ifdef FIFO_PROFILING
+        ctx->wakeup_cnt++;
+#endif // FIFO_PROFILING
 
         // We got the event, simply repeat the loop. Note that getting an event
         // does not guarantee there is really new data in the dataport FIFO.
@@ -267,6 +1154,123 @@ blocking_read(
 }
 
 
+#ifdef CAPACITY_SEARCH
+
+typedef struct {
+    size_t         dataport_limit;
+    size_t         rx_fifo_limit;
+    size_t         step_start; // bytes processed when the step started
+    size_t         step_overflows; // overflows when the step started
+    bool           is_found;
+    size_t         best_dataport;
+    size_t         best_rx_fifo;
+} capacity_search_t;
+
+
+//---------------------------------------------------------------------------
+static void
+capacity_search_start_step(
+    test_ctx_t*         ctx,
+    capacity_search_t*  search)
+{
+    ctx->rx_fifo_limit = search->rx_fifo_limit;
+    ctx->fifo_peak = 0;
+    ctx->rx_fifo_peak = 0;
+    search->step_start = ctx->bytes_processed;
+    search->step_overflows = ctx->overflows;
+}
+
+
+//---------------------------------------------------------------------------
+static void
+capacity_search_init(
+    test_ctx_t*         ctx,
+    capacity_search_t*  search)
+{
+    *search = (capacity_search_t) {
+        .dataport_limit = FifoDataport_getCapacity(ctx->uart_fifo),
+        .rx_fifo_limit  = CAPACITY_SEARCH_MIN,
+    };
+
+    Debug_LOG_INFO(
+        "capacity search: %d baud, %d bytes per step, %u ops per byte",
+        UART_TEST_BAUD_RATE, CAPACITY_SEARCH_BYTES, ctx->load.ops_per_byte);
+
+    capacity_search_start_step(ctx, search);
+}
+
+
+//---------------------------------------------------------------------------
+// Evaluate the current step once it has run long enough and set up the next.
+// Returns true when the search is complete.
+static bool
+capacity_search_update(
+    test_ctx_t*         ctx,
+    capacity_search_t*  search)
+{
+    if (ctx->bytes_processed - search->step_start < CAPACITY_SEARCH_BYTES)
+    {
+        return false;
+    }
+
+    // The dataport FIFO fill level is sampled on each read, which is when it
+    // is highest.
+    const bool is_ok = (ctx->fifo_peak <= search->dataport_limit)
+                       && (ctx->overflows == search->step_overflows);
+    Debug_LOG_INFO(
+        "capacity search: dataport %zu, FIFO %zu: %s, peak dataport %zu, "
+        "FIFO %zu",
+        search->dataport_limit, search->rx_fifo_limit,
+        is_ok ? "ok" : "overflow", ctx->fifo_peak, ctx->rx_fifo_peak);
+
+    bool is_done = false;
+    if (is_ok)
+    {
+        const size_t total = search->dataport_limit + search->rx_fifo_limit;
+        if (!search->is_found
+            || (total < search->best_dataport + search->best_rx_fifo))
+        {
+            search->is_found = true;
+            search->best_dataport = search->dataport_limit;
+            search->best_rx_fifo = search->rx_fifo_limit;
+        }
+
+        // A smaller dataport FIFO needs at least the same internal FIFO.
+        search->dataport_limit /= 2;
+        is_done = (search->dataport_limit < CAPACITY_SEARCH_MIN);
+    }
+    else
+    {
+        // If no internal FIFO size works, a smaller dataport FIFO won't work
+        // either.
+        search->rx_fifo_limit *= 2;
+        is_done = (search->rx_fifo_limit
+                   > ringbuffer_getCapacity(&(ctx->rx_fifo.rb)));
+    }
+
+    if (is_done)
+    {
+        if (search->is_found)
+        {
+            Debug_LOG_INFO(
+                "capacity search: smallest overflow-free configuration is "
+                "dataport %zu, FIFO %zu",
+                search->best_dataport, search->best_rx_fifo);
+        }
+        else
+        {
+            Debug_LOG_WARNING("capacity search: no overflow-free configuration");
+        }
+        return true;
+    }
+
+    capacity_search_start_step(ctx, search);
+    return false;
+}
+
+#endif // CAPACITY_SEARCH
+
+
 //---------------------------------------------------------------------------
 static OS_Error_t
 do_run_test(void)
@@ -276,21 +1280,58 @@ do_run_test(void)
 
     static test_ctx_t ctx = { 0 }; // don't use the stack
 
-    ctx.uart_fifo = (FifoDataport*)buf_port;
+    ctx.spin_limit = (RX_SPIN_MIN + RX_SPIN_MAX) / 2;
+
+    ctx.load = (load_model_t) {
+        .ops_per_byte    = LOAD_OPS_PER_BYTE,
+        .ops_per_span    = LOAD_OPS_PER_SPAN,
+        .stall_interval  = LOAD_STALL_INTERVAL,
+        .stall_ops       = LOAD_STALL_OPS,
+        .memory_per_span = LOAD_MEMORY_PER_SPAN,
+    };
+    Debug_LOG_INFO(
+        "load: %u ops per byte, %u ops per span, %u ops stall every %zu "
+        "bytes, %zu bytes memory per span",
+        ctx.load.ops_per_byte, ctx.load.ops_per_span, ctx.load.stall_ops,
+        ctx.load.stall_interval, ctx.load.memory_per_span);
+
+    rx_fifo_t* rx_fifo = &(ctx.rx_fifo);
+    rx_fifo_init(rx_fifo);
+    ctx.rx_fifo_limit = ringbuffer_getCapacity(&(rx_fifo->rb));
+
+#ifdef TEST_PATTERN_PRBS
+    if (!prbs_init(&(ctx.prbs), TEST_PATTERN_PRBS))
+    {
+        Debug_LOG_ERROR("unsupported PRBS order %d", TEST_PATTERN_PRBS);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+#endif // TEST_PATTERN_PRBS
 
-    ringbuffer_t* rb = &(ctx.rb);
-    ringbuffer_init(rb, ctx.fifo_buffer, sizeof(ctx.fifo_buffer));
+#ifdef TEST_FRAMED_CRC
+    ctx.frame_crc = FRAME_CRC_INIT;
+#endif // TEST_FRAMED_CRC
 
     // test runner check for this string
     Debug_LOG_DEBUG("UART tester loop running");
 
+    // The driver has a lower priority, so it may not have set up the dataport
+    // yet. It has done so before it signals data for the first time.
+    uart_event_wait();
+    setup_dataport(&ctx, buf_port);
+
+#ifdef CAPACITY_SEARCH
+    static capacity_search_t search;
+    capacity_search_init(&ctx, &search);
+#endif // CAPACITY_SEARCH
+
     for(;;)
     {
         OS_Error_t ret;
 
         // Read as much data as possible from the dataport FIFO into the
         // internal FIFO. If both the internal FIFO and the dataport FIFO are
-        // empty, this will block until data is available.
+        // empty, this will block until data is available. In zero-copy mode,
+        // data is only moved when the dataport FIFO fills up.
         ret = blocking_read(&ctx);
         if (OS_SUCCESS != ret)
         {
@@ -299,18 +1340,280 @@ do_run_test(void)
         }
 
         // If we arrive here, there is data in the internal FIFO available for
-        // processing.
-        assert( !ringbuffer_isEmpty(rb) );
+        // processing, or in the dataport FIFO for processing in place.
+#ifdef RX_ZERO_COPY
+        assert( !rx_fifo_isEmpty(rx_fifo)
+                || (FifoDataport_getSize(ctx.uart_fifo) > 0) );
+#else
+        assert( !rx_fifo_isEmpty(rx_fifo) );
+#endif // RX_ZERO_COPY
         ret = process_data(&ctx);
         if (OS_SUCCESS != ret)
         {
             Debug_LOG_ERROR("process_data() failed, code %d", ret);
             return OS_ERROR_GENERIC;
         }
+
+#ifdef CAPACITY_SEARCH
+        if (capacity_search_update(&ctx, &search))
+        {
+            return OS_SUCCESS;
+        }
+#endif // CAPACITY_SEARCH
     } // end for (;;)
 }
 
 
+//---------------------------------------------------------------------------
+typedef struct {
+    uint8_t*       buf; // output dataport
+    size_t         batch_size;
+    uint8_t        next_byte; // incrementing sequence
+#ifdef TEST_PATTERN_PRBS
+    prbs_t         prbs;
+#endif // TEST_PATTERN_PRBS
+#ifdef TEST_FRAMED_CRC
+    size_t         frame_pos; // bytes of the current frame sent
+    uint32_t       frame_crc; // CRC over the payload sent so far
+#endif // TEST_FRAMED_CRC
+    size_t         calls;
+#ifdef TIMEBASE_AVAILABLE
+    uint64_t       call_ticks; // ticks spent in write calls
+    uint64_t       call_ticks_max;
+#endif // TIMEBASE_AVAILABLE
+} tx_ctx_t;
+
+
+//---------------------------------------------------------------------------
+static void
+tx_fill_pattern(
+    tx_ctx_t*  ctx,
+    uint8_t*   buf,
+    size_t     len)
+{
+#ifdef TEST_PATTERN_PRBS
+    prbs_generate(&(ctx->prbs), buf, len);
+#else
+    for (size_t i = 0; i < len; i++)
+    {
+        buf[i] = ctx->next_byte++;
+    }
+#endif // TEST_PATTERN_PRBS
+}
+
+
+//---------------------------------------------------------------------------
+// Fill the buffer with the test data. In framed mode, the test pattern is the
+// payload and each frame is followed by its CRC, as verify_frames() expects.
+static void
+tx_fill(
+    tx_ctx_t*  ctx,
+    uint8_t*   buf,
+    size_t     len)
+{
+#ifdef TEST_FRAMED_CRC
+    size_t i = 0;
+    while (i < len)
+    {
+        if (ctx->frame_pos < TEST_FRAME_SIZE)
+        {
+            const size_t cnt = MIN(len - i, TEST_FRAME_SIZE - ctx->frame_pos);
+            tx_fill_pattern(ctx, &buf[i], cnt);
+            ctx->frame_crc = frame_crc_update(ctx->frame_crc, &buf[i], cnt);
+            ctx->frame_pos += cnt;
+            i += cnt;
+            continue;
+        }
+
+        const uint32_t crc = frame_crc_final(ctx->frame_crc);
+        buf[i] = (uint8_t)(crc >> (8 * (ctx->frame_pos - TEST_FRAME_SIZE)));
+        ctx->frame_pos++;
+        i++;
+        if (ctx->frame_pos == FRAME_TOTAL_SIZE)
+        {
+            ctx->frame_pos = 0;
+            ctx->frame_crc = FRAME_CRC_INIT;
+        }
+    }
+#else
+    tx_fill_pattern(ctx, buf, len);
+#endif // TEST_FRAMED_CRC
+}
+
+
+//---------------------------------------------------------------------------
+// Send len bytes from the start of the output dataport.
+static OS_Error_t
+tx_write(
+    tx_ctx_t*  ctx,
+    size_t     len)
+{
+    while (len > 0)
+    {
+        size_t written = 0;
+#ifdef TIMEBASE_AVAILABLE
+        const uint64_t start = timebase_getTicks();
+#endif // TIMEBASE_AVAILABLE
+        OS_Error_t ret = uart_rpc_write(len, &written);
+#ifdef TIMEBASE_AVAILABLE
+        const uint64_t ticks = timebase_getTicks() - start;
+        ctx->call_ticks += ticks;
+        ctx->call_ticks_max = MAX(ctx->call_ticks_max, ticks);
+#endif // TIMEBASE_AVAILABLE
+        ctx->calls++;
+
+        if (OS_SUCCESS != ret)
+        {
+            Debug_LOG_ERROR("uart_rpc_write() failed, code %d", ret);
+            return ret;
+        }
+        // The write is blocking, so it must make progress.
+        if ((0 == written) || (written > len))
+        {
+            Debug_LOG_ERROR("uart_rpc_write() wrote %zu of %zu", written, len);
+            return OS_ERROR_GENERIC;
+        }
+
+        // A partial write leaves the rest at the start of the dataport.
+        len -= written;
+        memmove(ctx->buf, &(ctx->buf[written]), len);
+    }
+
+    return OS_SUCCESS;
+}
+
+
+//---------------------------------------------------------------------------
+static OS_Error_t
+tx_init(
+    tx_ctx_t*  ctx)
+{
+    OS_Dataport_t out_port = OS_DATAPORT_ASSIGN(uart_output_port);
+
+    ctx->buf = (uint8_t*)OS_Dataport_getBuf(out_port);
+    ctx->batch_size = MIN(TX_BATCH_SIZE, OS_Dataport_getSize(out_port));
+
+#ifdef TEST_FRAMED_CRC
+    ctx->frame_crc = FRAME_CRC_INIT;
+#endif // TEST_FRAMED_CRC
+
+#ifdef TEST_PATTERN_PRBS
+    if (!prbs_init(&(ctx->prbs), TEST_PATTERN_PRBS))
+    {
+        Debug_LOG_ERROR("unsupported PRBS order %d", TEST_PATTERN_PRBS);
+        return OS_ERROR_INVALID_PARAMETER;
+    }
+#endif // TEST_PATTERN_PRBS
+
+    return OS_SUCCESS;
+}
+
+
+//---------------------------------------------------------------------------
+static OS_Error_t
+do_tx_benchmark(void)
+{
+    static tx_ctx_t ctx = { 0 }; // don't use the stack
+
+    OS_Error_t ret = tx_init(&ctx);
+    if (OS_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    Debug_LOG_INFO(
+        "UART tester TX benchmark running, %d rounds of %d bytes, batch %zu",
+        TX_BENCHMARK_ROUNDS, TX_BENCHMARK_BYTES, ctx.batch_size);
+
+    for (unsigned int round = 0; round < TX_BENCHMARK_ROUNDS; round++)
+    {
+        ctx.calls = 0;
+#ifdef TIMEBASE_AVAILABLE
+        ctx.call_ticks = 0;
+        ctx.call_ticks_max = 0;
+        const uint64_t start = timebase_getTicks();
+#endif // TIMEBASE_AVAILABLE
+
+        size_t sent = 0;
+        while (sent < TX_BENCHMARK_BYTES)
+        {
+            const size_t len = MIN(ctx.batch_size, TX_BENCHMARK_BYTES - sent);
+            tx_fill(&ctx, ctx.buf, len);
+            OS_Error_t ret = tx_write(&ctx, len);
+            if (OS_SUCCESS != ret)
+            {
+                return ret;
+            }
+            sent += len;
+        }
+
+        Debug_LOG_INFO(
+            "TX round %u: %zu bytes, %zu calls, %zu calls per MiB",
+            round, sent, ctx.calls,
+            (size_t)((uint64_t)ctx.calls * 1024 * 1024 / sent));
+#ifdef TIMEBASE_AVAILABLE
+        const uint64_t us = timebase_ticksToUs(timebase_getTicks() - start);
+        if (us > 0)
+        {
+            const uint64_t rate = (uint64_t)sent * 1000000 / us;
+            Debug_LOG_INFO(
+                "TX round %u: %" PRIu64 " B/s (%" PRIu64 "%% of %d baud), "
+                "write avg %" PRIu64 " us, max %" PRIu64 " us",
+                round, rate, rate * 10 * 100 / UART_TEST_BAUD_RATE,
+                UART_TEST_BAUD_RATE,
+                timebase_ticksToUs(ctx.call_ticks) / ctx.calls,
+                timebase_ticksToUs(ctx.call_ticks_max));
+        }
+#endif // TIMEBASE_AVAILABLE
+    }
+
+    return OS_SUCCESS;
+}
+
+
+#ifdef UART_TEST_LOOPBACK
+
+//---------------------------------------------------------------------------
+// Send the test pattern until an error occurs, runs in the tx_thread thread.
+static OS_Error_t
+do_tx_loopback(void)
+{
+    static tx_ctx_t ctx = { 0 }; // don't use the stack
+
+    OS_Error_t ret = tx_init(&ctx);
+    if (OS_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    for (;;)
+    {
+        tx_fill(&ctx, ctx.buf, ctx.batch_size);
+        ret = tx_write(&ctx, ctx.batch_size);
+        if (OS_SUCCESS != ret)
+        {
+            return ret;
+        }
+        __atomic_fetch_add(&loopback_tx_bytes, ctx.batch_size,
+                           __ATOMIC_RELAXED);
+    }
+}
+
+
+//---------------------------------------------------------------------------
+static void
+tx_thread_callback(
+    void* arg)
+{
+    Debug_LOG_DEBUG("loopback TX thread running");
+
+    OS_Error_t ret = do_tx_loopback();
+    Debug_LOG_ERROR("do_tx_loopback() failed, code %d", ret);
+}
+
+#endif // UART_TEST_LOOPBACK
+
+
 //---------------------------------------------------------------------------
 void pre_init(void)
 {
@@ -322,6 +1625,20 @@ void pre_init(void)
 void post_init(void)
 {
     Debug_LOG_DEBUG("post_init");
+
+#ifdef TEST_FRAMED_CRC
+    // The RX test and the TX thread share the tables, build them before
+    // either runs.
+    crc_init();
+#endif // TEST_FRAMED_CRC
+
+#ifdef UART_TEST_LOOPBACK
+    int err = tx_thread_reg_callback(tx_thread_callback, NULL);
+    if (0 != err)
+    {
+        Debug_LOG_ERROR("tx_thread_reg_callback() failed, code %d", err);
+    }
+#endif // UART_TEST_LOOPBACK
 }
 
 
@@ -330,10 +1647,23 @@ int run()
 {
     Debug_LOG_DEBUG("run");
 
-    OS_Error_t ret = do_run_test();
+#ifdef TX_BENCHMARK
+    const bool is_tx_benchmark = true;
+#else
+    const bool is_tx_benchmark = false;
+#endif // TX_BENCHMARK
+
+#ifdef UART_TEST_LOOPBACK
+    // Start sending, the RX test below verifies the echoed data.
+    tx_start_emit();
+#endif // UART_TEST_LOOPBACK
+
+    OS_Error_t ret = is_tx_benchmark ? do_tx_benchmark() : do_run_test();
     if (OS_SUCCESS != ret)
     {
-        Debug_LOG_ERROR("do_run_test() failed, code %d", ret);
+        Debug_LOG_ERROR(
+            "%s() failed, code %d",
+            is_tx_benchmark ? "do_tx_benchmark" : "do_run_test", ret);
         return -1;
     }
 